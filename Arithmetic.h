@@ -0,0 +1,161 @@
+#pragma once
+
+#include <any>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>      // std::index_sequence
+#include "RuntimeError.h"
+#include "Token.h"
+#include "TokenType.h"
+
+// The arithmetic of SNOL values, shared by every engine. Each operator has
+// one kernel per value type; integer kernels check for overflow and zero
+// divisors with compiler builtins instead of running into undefined
+// behaviour. A kernel returns nullptr on success or the error message, so
+// that the interpreter can throw it and the batch evaluator can record it
+// against a single row.
+
+enum ValueType {
+  INT_VALUE, DOUBLE_VALUE,
+
+  VALUE_TYPE_COUNT,
+};
+
+enum ArithmeticOp {
+  ADD, SUBTRACT, MULTIPLY, DIVIDE, REMAINDER,
+
+  ARITHMETIC_OP_COUNT,
+};
+
+template <ValueType Type>
+using ValueOf = std::conditional_t<Type == INT_VALUE, std::int64_t, double>;
+
+constexpr char TYPE_MISMATCH[] =
+    "Operands must be of the same type in an arithmetic operation!";
+constexpr char DIVISION_BY_ZERO[] = "Error! Division by zero!";
+constexpr char INTEGER_OVERFLOW[] = "Error! Integer overflow!";
+
+// Returns VALUE_TYPE_COUNT if value is not a number.
+inline ValueType valueType(const std::any& value) {
+  if (value.type() == typeid(std::int64_t)) return INT_VALUE;
+  if (value.type() == typeid(double)) return DOUBLE_VALUE;
+  return VALUE_TYPE_COUNT;
+}
+
+// Returns ARITHMETIC_OP_COUNT if type is not an arithmetic operator.
+constexpr ArithmeticOp arithmeticOp(TokenType type) {
+  switch (type) {
+    case PLUS: return ADD;
+    case MINUS: return SUBTRACT;
+    case STAR: return MULTIPLY;
+    case SLASH: return DIVIDE;
+    case MODULO: return REMAINDER;
+    default: return ARITHMETIC_OP_COUNT;
+  }
+}
+
+template <ArithmeticOp Op, class T>
+constexpr const char* kernel(T left, T right, T& result) {
+  if constexpr (std::is_same_v<T, std::int64_t>) {
+    if constexpr (Op == ADD) {
+      return __builtin_add_overflow(left, right, &result) ? INTEGER_OVERFLOW
+                                                          : nullptr;
+    } else if constexpr (Op == SUBTRACT) {
+      return __builtin_sub_overflow(left, right, &result) ? INTEGER_OVERFLOW
+                                                          : nullptr;
+    } else if constexpr (Op == MULTIPLY) {
+      return __builtin_mul_overflow(left, right, &result) ? INTEGER_OVERFLOW
+                                                          : nullptr;
+    } else {
+      if (right == 0) return DIVISION_BY_ZERO;
+      // The minimum divided by -1 is the one quotient that overflows.
+      if (right == -1) {
+        if constexpr (Op == REMAINDER) {
+          result = 0;
+          return nullptr;
+        }
+        return __builtin_sub_overflow(T{0}, left, &result) ? INTEGER_OVERFLOW
+                                                           : nullptr;
+      }
+      result = Op == DIVIDE ? left / right : left % right;
+      return nullptr;
+    }
+  } else {
+    switch (Op) {
+      case ADD: result = left + right; return nullptr;
+      case SUBTRACT: result = left - right; return nullptr;
+      case MULTIPLY: result = left * right; return nullptr;
+      case DIVIDE: result = left / right; return nullptr;
+      default: return TYPE_MISMATCH;
+    }
+  }
+}
+
+template <class T>
+constexpr const char* negateKernel(T value, T& result) {
+  if constexpr (std::is_same_v<T, std::int64_t>) {
+    return __builtin_sub_overflow(T{0}, value, &result) ? INTEGER_OVERFLOW
+                                                        : nullptr;
+  } else {
+    result = -value;
+    return nullptr;
+  }
+}
+
+using BinaryFunction = std::any (*)(const std::any& left,
+                                    const std::any& right, const Token& op);
+
+// Applies the kernel for one combination of operand types and operator to
+// values already known to have those types.
+template <ValueType Left, ValueType Right, ArithmeticOp Op>
+std::any binaryEntry(const std::any& left, const std::any& right,
+                     const Token& op) {
+  if constexpr (Left != Right) {
+    throw RuntimeError{op, TYPE_MISMATCH};
+  } else {
+    using T = ValueOf<Left>;
+    T result{};
+    if (const char* error = kernel<Op>(*std::any_cast<T>(&left),
+                                       *std::any_cast<T>(&right), result)) {
+      throw RuntimeError{op, error};
+    }
+    return result;
+  }
+}
+
+constexpr std::size_t binaryIndex(ValueType left, ValueType right,
+                                  ArithmeticOp op) {
+  return (left * VALUE_TYPE_COUNT + right) * ARITHMETIC_OP_COUNT + op;
+}
+
+template <std::size_t... I>
+constexpr auto makeBinaryTable(std::index_sequence<I...>) {
+  return std::array<BinaryFunction, sizeof...(I)>{
+    &binaryEntry<
+        static_cast<ValueType>(I / ARITHMETIC_OP_COUNT / VALUE_TYPE_COUNT),
+        static_cast<ValueType>(I / ARITHMETIC_OP_COUNT % VALUE_TYPE_COUNT),
+        static_cast<ArithmeticOp>(I % ARITHMETIC_OP_COUNT)>...
+  };
+}
+
+// Every entry, laid out as [left type][right type][operator].
+inline constexpr auto BINARY_TABLE = makeBinaryTable(
+    std::make_index_sequence<
+        VALUE_TYPE_COUNT * VALUE_TYPE_COUNT * ARITHMETIC_OP_COUNT>{});
+
+// Computes left op right, throwing a RuntimeError at op if the operands
+// do not fit the operator or the result is undefined.
+inline std::any arithmetic(const std::any& left, const std::any& right,
+                           const Token& op) {
+  ValueType leftType = valueType(left);
+  ValueType rightType = valueType(right);
+  ArithmeticOp operation = arithmeticOp(op.type);
+  if (leftType == VALUE_TYPE_COUNT || rightType == VALUE_TYPE_COUNT ||
+      operation == ARITHMETIC_OP_COUNT) {
+    throw RuntimeError{op, "Operands must be numbers."};
+  }
+  return BINARY_TABLE[binaryIndex(leftType, rightType, operation)](
+      left, right, op);
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>    // std::min
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>     // std::make_move_iterator
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>      // std::move
+#include <vector>
+#include "Arithmetic.h"
+#include "Column.h"
+#include "Expr.h"
+#include "Natives.h"
+#include "RuntimeError.h"
+#include "Token.h"
+#include "TokenType.h"
+
+// Evaluates one expression over many rows of variable bindings. The tree is
+// walked once per chunk of rows, and each operator runs as a tight loop
+// over the chunk that the compiler can vectorize.
+//
+// Every input column has a single type, so a type error applies to all
+// rows alike and is raised as a RuntimeError; errors that depend on the
+// values, like division by zero or overflow, are reported per row. The
+// operators use the interpreter's kernels from Arithmetic.h.
+class BatchEvaluator: public ExprVisitor {
+  static constexpr std::size_t CHUNK_SIZE = 1024;
+
+  struct Chunk {
+    bool isInt = true;
+    std::vector<std::int64_t> ints;
+    std::vector<double> doubles;
+    // Empty when no row has failed.
+    std::vector<const char*> errors;
+  };
+
+  const std::map<std::string, Column>& columns;
+  std::size_t offset = 0;
+  std::size_t count = 0;
+  // The walk of the expression, and the chunks of the visited nodes that
+  // their parents have yet to take, as in the interpreter.
+  std::vector<WalkFrame> frames;
+  std::vector<Chunk> chunks;
+  // Why each row of the last integer loop failed, if it did. The flags are
+  // as wide as the values so that setting them needs no narrowing.
+  enum : std::uint64_t { OVERFLOWED = 1, DIVIDED_BY_ZERO = 2 };
+  std::uint64_t flags[CHUNK_SIZE];
+  static_assert(OVERFLOWED == 1, "Overflow is flagged by a shifted sign bit.");
+
+public:
+  BatchEvaluator(const std::map<std::string, Column>& columns)
+    : columns{columns}
+  {}
+
+  BatchResult evaluate(const std::shared_ptr<Expr>& expr, std::size_t rows) {
+    BatchResult result;
+    result.errors.resize(rows);
+
+    for (offset = 0; offset < rows; offset += count) {
+      count = std::min(CHUNK_SIZE, rows - offset);
+      chunks.clear();
+      walkPostfix(*expr, frames, [this](Expr& node) { node.accept(*this); });
+      Chunk chunk = std::move(chunks.back());
+
+      result.values.isInt = chunk.isInt;
+      // Every chunk has the first one's type, so size the results once.
+      if (offset == 0) {
+        if (chunk.isInt) {
+          result.values.ints.reserve(rows);
+        } else {
+          result.values.doubles.reserve(rows);
+        }
+      }
+      if (chunk.isInt) {
+        result.values.ints.insert(result.values.ints.end(),
+                                  chunk.ints.begin(), chunk.ints.end());
+      } else {
+        result.values.doubles.insert(result.values.doubles.end(),
+                                     chunk.doubles.begin(),
+                                     chunk.doubles.end());
+      }
+      for (std::size_t i = 0; i < chunk.errors.size(); ++i) {
+        if (chunk.errors[i]) result.errors[offset + i] = chunk.errors[i];
+      }
+    }
+
+    return result;
+  }
+
+  std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
+    throw RuntimeError{expr->name,
+        "Error! Assignments cannot be evaluated in a batch!"};
+  }
+
+  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
+    Chunk right = std::move(chunks.back());
+    chunks.pop_back();
+    Chunk& left = chunks.back();
+
+    if (left.isInt != right.isInt ||
+        (!left.isInt && expr->op.type == MODULO)) {
+      throw RuntimeError{expr->op,
+          "Operands must be of the same type in an arithmetic operation!"};
+    }
+
+    mergeErrors(left, right);
+    if (left.isInt) {
+      binary(expr->op.type, left.ints.data(), right.ints.data(), left);
+    } else {
+      binary(expr->op.type, left.doubles.data(), right.doubles.data(), left);
+    }
+    return {};
+  }
+
+  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
+    const Native& native = *expr->native;
+    std::vector<Chunk> arguments(
+        std::make_move_iterator(chunks.end() - expr->arguments.size()),
+        std::make_move_iterator(chunks.end()));
+    chunks.resize(chunks.size() - expr->arguments.size());
+
+    Chunk result;
+    result.isInt = arguments.empty() ? native.intFunction != nullptr
+                                     : arguments[0].isInt;
+    for (Chunk& argument : arguments) {
+      if (argument.isInt != result.isInt) {
+        throw RuntimeError{expr->paren,
+            "Arguments must be of the same type in a function call!"};
+      }
+      mergeErrors(result, argument);
+    }
+    if (result.isInt ? !native.intFunction : !native.doubleFunction) {
+      throw RuntimeError{expr->callee, "Error! [" + native.name +
+          "] does not take " + (result.isInt ? "integer" : "float") +
+          " arguments!"};
+    }
+
+    if (result.isInt) {
+      result.ints.resize(count);
+      std::int64_t args[MAX_NATIVE_ARITY];
+      for (std::size_t row = 0; row < count; ++row) {
+        for (std::size_t i = 0; i < arguments.size(); ++i) {
+          args[i] = arguments[i].ints[row];
+        }
+        try {
+          result.ints[row] = native.intFunction(args);
+        } catch (const NativeError& error) {
+          fail(result, row, error.message);
+        }
+      }
+    } else {
+      result.doubles.resize(count);
+      double args[MAX_NATIVE_ARITY];
+      for (std::size_t row = 0; row < count; ++row) {
+        for (std::size_t i = 0; i < arguments.size(); ++i) {
+          args[i] = arguments[i].doubles[row];
+        }
+        try {
+          result.doubles[row] = native.doubleFunction(args);
+        } catch (const NativeError& error) {
+          fail(result, row, error.message);
+        }
+      }
+    }
+    chunks.push_back(std::move(result));
+    return {};
+  }
+
+  std::any visitGroupingExpr(
+      std::shared_ptr<Grouping> expr) override {
+    return {};
+  }
+
+  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+    Chunk chunk;
+    chunk.isInt = expr->value.type() == typeid(std::int64_t);
+    if (chunk.isInt) {
+      chunk.ints.assign(count, std::any_cast<std::int64_t>(expr->value));
+    } else {
+      chunk.doubles.assign(count, std::any_cast<double>(expr->value));
+    }
+    chunks.push_back(std::move(chunk));
+    return {};
+  }
+
+  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
+    Chunk& chunk = chunks.back();
+    if (chunk.isInt) {
+      negate(chunk.ints.data(), chunk);
+    } else {
+      negate(chunk.doubles.data(), chunk);
+    }
+    return {};
+  }
+
+  std::any visitVariableExpr(
+      std::shared_ptr<Variable> expr) override {
+    auto column = columns.find(expr->name.lexeme);
+    if (column == columns.end()) {
+      throw RuntimeError{expr->name,
+          "Error! [" + expr->name.lexeme + "] is not defined!"};
+    }
+    if (column->second.size() < offset + count) {
+      throw RuntimeError{expr->name,
+          "Error! [" + expr->name.lexeme + "] has too few rows!"};
+    }
+
+    Chunk chunk;
+    chunk.isInt = column->second.isInt;
+    if (chunk.isInt) {
+      chunk.ints.assign(column->second.ints.begin() + offset,
+                        column->second.ints.begin() + offset + count);
+    } else {
+      chunk.doubles.assign(column->second.doubles.begin() + offset,
+                           column->second.doubles.begin() + offset + count);
+    }
+    chunks.push_back(std::move(chunk));
+    return {};
+  }
+
+private:
+  static void mergeErrors(Chunk& left, const Chunk& right) {
+    if (right.errors.empty()) return;
+    if (left.errors.empty()) {
+      left.errors = right.errors;
+      return;
+    }
+    for (std::size_t i = 0; i < left.errors.size(); ++i) {
+      if (!left.errors[i]) left.errors[i] = right.errors[i];
+    }
+  }
+
+  // Computes left op right into left, with one loop per operator so that
+  // each loop body is a single kernel.
+  template <class T>
+  void binary(TokenType op, T* left, const T* right, Chunk& result) {
+    switch (arithmeticOp(op)) {
+      case ADD: apply<ADD>(left, right, result); break;
+      case SUBTRACT: apply<SUBTRACT>(left, right, result); break;
+      case MULTIPLY: apply<MULTIPLY>(left, right, result); break;
+      case DIVIDE: apply<DIVIDE>(left, right, result); break;
+      case REMAINDER: apply<REMAINDER>(left, right, result); break;
+      default: break;
+    }
+  }
+
+  // Float kernels never fail, so once inlined the loop has no branches.
+  template <ArithmeticOp Op>
+  void apply(double* left, const double* right, Chunk& result) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (const char* error = kernel<Op>(left[i], right[i], left[i])) {
+        fail(result, i, error);
+      }
+    }
+  }
+
+  // Integer kernels can fail on any row, and a branch to record the error
+  // keeps the loop from vectorizing. Instead the whole chunk is computed
+  // with the checks folded into a flag per row, and failed rows are
+  // recorded in a second pass that only runs if any row failed. Rows that
+  // fail get the same errors as from kernel; their values are unspecified.
+  template <ArithmeticOp Op>
+  void apply(std::int64_t* left, const std::int64_t* right, Chunk& result) {
+    constexpr std::int64_t MIN = std::numeric_limits<std::int64_t>::min();
+    // A local bound, since the stores below could alias count.
+    std::size_t rows = count;
+    std::uint64_t failed = 0;
+    for (std::size_t i = 0; i < rows; ++i) {
+      std::int64_t a = left[i];
+      std::int64_t b = right[i];
+      // Wrapping arithmetic is done on unsigned values, which is defined.
+      auto ua = static_cast<std::uint64_t>(a);
+      auto ub = static_cast<std::uint64_t>(b);
+      std::int64_t value;
+      std::uint64_t flag;
+      // A sum or difference overflows when its sign differs from the sign
+      // both operands would give it; shifting down the sign bit of that
+      // test gives OVERFLOWED or 0.
+      if constexpr (Op == ADD) {
+        std::uint64_t sum = ua + ub;
+        value = static_cast<std::int64_t>(sum);
+        flag = ((ua ^ sum) & (ub ^ sum)) >> 63;
+      } else if constexpr (Op == SUBTRACT) {
+        std::uint64_t difference = ua - ub;
+        value = static_cast<std::int64_t>(difference);
+        flag = ((ua ^ ub) & (ua ^ difference)) >> 63;
+      } else if constexpr (Op == MULTIPLY) {
+        flag = __builtin_mul_overflow(a, b, &value) ? OVERFLOWED : 0;
+      } else {
+        // Divide by 1 instead of 0 or -1, then patch in the -1 results.
+        bool zero = b == 0;
+        bool minusOne = b == -1;
+        std::int64_t divisor = zero | minusOne ? 1 : b;
+        std::int64_t quotient = Op == DIVIDE ? a / divisor : a % divisor;
+        std::int64_t negated = Op == DIVIDE
+            ? static_cast<std::int64_t>(0 - ua) : 0;
+        value = minusOne ? negated : quotient;
+        flag = (zero ? DIVIDED_BY_ZERO : 0) |
+            (Op == DIVIDE && minusOne && a == MIN ? OVERFLOWED : 0);
+      }
+      left[i] = value;
+      flags[i] = flag;
+      failed |= flag;
+    }
+    if (failed) recordFlags(result);
+  }
+
+  void negate(double* values, Chunk&) {
+    for (std::size_t i = 0; i < count; ++i) values[i] = -values[i];
+  }
+
+  void negate(std::int64_t* values, Chunk& result) {
+    std::size_t rows = count;
+    std::uint64_t failed = 0;
+    for (std::size_t i = 0; i < rows; ++i) {
+      auto value = static_cast<std::uint64_t>(values[i]);
+      std::uint64_t negated = 0 - value;
+      // Only the minimum is negative both before and after negating it.
+      std::uint64_t flag = (value & negated) >> 63;
+      values[i] = static_cast<std::int64_t>(negated);
+      flags[i] = flag;
+      failed |= flag;
+    }
+    if (failed) recordFlags(result);
+  }
+
+  // Records the errors of the rows flagged by the last integer loop.
+  void recordFlags(Chunk& result) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (flags[i] & DIVIDED_BY_ZERO) {
+        fail(result, i, DIVISION_BY_ZERO);
+      } else if (flags[i] & OVERFLOWED) {
+        fail(result, i, INTEGER_OVERFLOW);
+      }
+    }
+  }
+
+  // Records the first error of a row.
+  void fail(Chunk& result, std::size_t row, const char* error) {
+    if (result.errors.empty()) result.errors.assign(count, nullptr);
+    if (!result.errors[row]) result.errors[row] = error;
+  }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A column of values of one type, one value per row.
+struct Column {
+  bool isInt = true;
+  std::vector<std::int64_t> ints;
+  std::vector<double> doubles;
+
+  std::size_t size() const {
+    return isInt ? ints.size() : doubles.size();
+  }
+};
+
+struct BatchResult {
+  // One value per row; those of failed rows are meaningless.
+  Column values;
+  // The error message of each row, or nullptr if it succeeded. Messages
+  // are static strings, so recording one costs no allocation.
+  std::vector<const char*> errors;
+};
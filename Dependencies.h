@@ -0,0 +1,56 @@
+#pragma once
+
+#include <any>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "Expr.h"
+
+// Collects the names of the variables an expression reads. The tree is
+// walked with walkPostfix, so nesting depth costs no native stack.
+class DependencyCollector: public ExprVisitor {
+  std::set<std::string> names;
+  std::vector<WalkFrame> frames;
+
+public:
+  std::vector<std::string> collect(const std::shared_ptr<Expr>& expr) {
+    walkPostfix(*expr, frames, [this](Expr& node) { node.accept(*this); });
+    return {names.begin(), names.end()};
+  }
+
+  std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
+    return {};
+  }
+
+  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
+    return {};
+  }
+
+  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
+    return {};
+  }
+
+  std::any visitGroupingExpr(
+      std::shared_ptr<Grouping> expr) override {
+    return {};
+  }
+
+  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+    return {};
+  }
+
+  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
+    return {};
+  }
+
+  std::any visitVariableExpr(
+      std::shared_ptr<Variable> expr) override {
+    names.insert(expr->name.lexeme);
+    return {};
+  }
+};
+
+inline std::vector<std::string> dependencies(const std::shared_ptr<Expr>& expr) {
+  return DependencyCollector{}.collect(expr);
+}
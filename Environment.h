@@ -1,42 +1,241 @@
 #pragma once
 
 #include <any>
+#include <cstddef>
+#include <cstdint>
 #include <functional> // less
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
-#include <utility>    // std::move
+#include <utility>    // std::exchange, std::move
+#include <vector>
 #include "Error.h"
+#include "Expr.h"
+#include "Limits.h"
+#include "Metrics.h"
+#include "SharedEnvironment.h"
 #include "Token.h"
 
 class Environment: public std::enable_shared_from_this<Environment> {
+  // A variable bound with := remembers its expression and is marked dirty
+  // whenever a variable it reads changes; the interpreter recomputes dirty
+  // formulas when they are read.
+  struct Formula {
+    std::shared_ptr<Expr> expression;
+    std::vector<std::string> dependencies;
+    bool dirty = false;
+  };
+
   std::map<std::string, std::any> values;
+  std::map<std::string, Formula> formulas;
+  // The formulas reading each variable.
+  std::map<std::string, std::set<std::string>> dependents;
+
+  // Read-only variables shared with other sessions, consulted when a name
+  // is not defined here. Updates to them do not mark formulas dirty.
+  std::shared_ptr<SharedEnvironment> shared;
+  std::shared_ptr<const SharedEnvironment::Snapshot> sharedValues;
+  std::uint64_t sharedVersion = 0;
 
 public:
+  // The most variables assign and bind may define; zero for no limit.
+  std::size_t maxVariables = 0;
+
+  Environment(std::shared_ptr<SharedEnvironment> shared = nullptr)
+    : shared{std::move(shared)}
+  {}
+
+  ~Environment() {
+    Metrics::variablesChanged(-static_cast<std::int64_t>(values.size()));
+  }
+
   std::any get(const Token& name) {
     auto elem = values.find(name.lexeme);
     if (elem != values.end()) {
       return elem->second;
     }
 
+    if (shared) {
+      const SharedEnvironment::Snapshot& snapshot = sharedSnapshot();
+      auto sharedElem = snapshot.find(name.lexeme);
+      if (sharedElem != snapshot.end()) {
+        return sharedElem->second;
+      }
+    }
+
     throw RuntimeError(name,
         "Error! [" + name.lexeme + "] is not defined!");
   }
 
-  void assign(const Token& name, std::any value) {
-    auto elem = values.find(name.lexeme);
-    if (elem != values.end()) {
-      elem->second = std::move(value);
+  // Whether name holds a plain value of this environment's own, which
+  // only assigning name can change.
+  bool holdsValue(const std::string& name) const {
+    return values.count(name) != 0 && formulas.count(name) == 0;
+  }
+
+  // Whether get would find name, here or among the shared variables.
+  bool defined(const std::string& name) {
+    if (values.find(name) != values.end()) return true;
+    return shared && sharedSnapshot().count(name) != 0;
+  }
+
+  // Assigns a value, defining the variable if needed, and returns the
+  // previous value (empty if there was none).
+  std::any assign(const Token& name, std::any value) {
+    checkCapacity(name);
+    // Without formulas there is nothing to unbind or invalidate, which
+    // keeps plain assignments in loops to a single lookup.
+    if (!formulas.empty()) {
+      unbind(name.lexeme);
+      invalidate(name.lexeme);
+    }
+    return define(name.lexeme, std::move(value));
+  }
+
+  std::any define(const std::string& name, std::any value) {
+    auto [elem, inserted] = values.try_emplace(name);
+    if (inserted) {
+      Metrics::variablesChanged(1);
+    }
+    return std::exchange(elem->second, std::move(value));
+  }
+
+  // Binds name to a formula whose current value is value, and returns the
+  // previous value (empty if there was none).
+  std::any bind(const Token& name, std::shared_ptr<Expr> expression,
+            std::vector<std::string> dependencies, std::any value) {
+    if (reaches(dependencies, name.lexeme)) {
+      throw RuntimeError(name,
+          "Error! [" + name.lexeme + "] cannot depend on itself!");
+    }
+
+    checkCapacity(name);
+    unbind(name.lexeme);
+    for (const std::string& dependency : dependencies) {
+      dependents[dependency].insert(name.lexeme);
     }
-    // if variable is not defined then we define it
-    else{
-      define(name.lexeme, std::move(value));
+    formulas[name.lexeme] = {std::move(expression), std::move(dependencies)};
+    invalidate(name.lexeme);
+    return define(name.lexeme, std::move(value));
+  }
+
+  // A formula to recompute, and the variable it is bound to.
+  struct StaleFormula {
+    std::string name;
+    std::shared_ptr<Expr> expression;
+  };
+
+  // Returns the dirty formulas that must be recomputed before name can be
+  // read: name's own if it is dirty, preceded by every dirty formula it
+  // reads directly or indirectly, each after the formulas it reads. Only
+  // dirty formulas are followed, since a clean formula reads none.
+  std::vector<StaleFormula> stale(const Token& name) {
+    std::vector<StaleFormula> order;
+    if (formulas.empty()) return order;
+    auto root = formulas.find(name.lexeme);
+    if (root == formulas.end() || !root->second.dirty) return order;
+
+    // A depth-first walk from an explicit stack, so chains of any length
+    // are ordered without recursion. Formulas cannot form cycles.
+    struct Frame {
+      const std::string* name;
+      const Formula* formula;
+      std::size_t next;
+    };
+    std::set<std::string> seen{name.lexeme};
+    std::vector<Frame> pending{{&root->first, &root->second, 0}};
+    while (!pending.empty()) {
+      Frame& frame = pending.back();
+      if (frame.next == frame.formula->dependencies.size()) {
+        order.push_back({*frame.name, frame.formula->expression});
+        pending.pop_back();
+        continue;
+      }
+
+      const std::string& dependency =
+          frame.formula->dependencies[frame.next++];
+      auto upstream = formulas.find(dependency);
+      if (upstream == formulas.end() || !upstream->second.dirty ||
+          !seen.insert(dependency).second) {
+        continue;
+      }
+      pending.push_back({&upstream->first, &upstream->second, 0});
+    }
+    return order;
+  }
+
+  // Stores the recomputed value of a stale formula.
+  void refresh(const std::string& name, std::any value) {
+    auto formula = formulas.find(name);
+    if (formula != formulas.end()) formula->second.dirty = false;
+    define(name, std::move(value));
+  }
+
+private:
+  const SharedEnvironment::Snapshot& sharedSnapshot() {
+    // Only reload the snapshot if a writer has published since.
+    std::uint64_t version = shared->currentVersion();
+    if (version != sharedVersion) {
+      sharedValues = shared->snapshot();
+      sharedVersion = version;
+    }
+    return *sharedValues;
+  }
+
+  void checkCapacity(const Token& name) {
+    if (maxVariables != 0 && values.size() >= maxVariables &&
+        values.find(name.lexeme) == values.end()) {
+      throw LimitError{"Error! Variable limit exceeded by [" + name.lexeme +
+          "]!"};
+    }
+  }
+
+  void unbind(const std::string& name) {
+    auto formula = formulas.find(name);
+    if (formula == formulas.end()) return;
+
+    for (const std::string& dependency : formula->second.dependencies) {
+      dependents[dependency].erase(name);
     }
-    return;
+    formulas.erase(formula);
   }
 
-  void define(const std::string& name, std::any value) {
-    values[name] = std::move(value);
+  // Marks every formula downstream of name dirty. A dirty formula's
+  // dependents are already dirty, so only newly affected ones are visited.
+  void invalidate(const std::string& name) {
+    std::vector<const std::string*> pending{&name};
+    while (!pending.empty()) {
+      auto readers = dependents.find(*pending.back());
+      pending.pop_back();
+      if (readers == dependents.end()) continue;
 
+      for (const std::string& reader : readers->second) {
+        Formula& formula = formulas[reader];
+        if (formula.dirty) continue;
+        formula.dirty = true;
+        pending.push_back(&reader);
+      }
+    }
+  }
+
+  // Whether target is one of names or is read, directly or through other
+  // formulas, by one of them.
+  bool reaches(const std::vector<std::string>& names,
+               const std::string& target) {
+    std::set<std::string> seen;
+    std::vector<std::string> pending{names};
+    while (!pending.empty()) {
+      std::string name = std::move(pending.back());
+      pending.pop_back();
+      if (name == target) return true;
+      if (!seen.insert(name).second) continue;
+
+      auto formula = formulas.find(name);
+      if (formula == formulas.end()) continue;
+      pending.insert(pending.end(), formula->second.dependencies.begin(),
+                     formula->second.dependencies.end());
+    }
+    return false;
   }
 };
@@ -2,18 +2,25 @@
 
 #include <iostream>
 #include <string_view>
+#include "Metrics.h"
 #include "RuntimeError.h"
 #include "Token.h"
 
-void report(std::string_view where,
+// Where errors are written. Threads that scan or parse ahead of the
+// interpreter point it at a buffer, so their errors can be replayed in
+// source order.
+inline thread_local std::ostream* errorStream = &std::cerr;
+
+inline void report(std::string_view where,
                    std::string_view message, bool& hadError) {
-  std::cerr <<
+  *errorStream <<
       "SNOL> Error! " << message <<
       "\n";
   hadError = true;
+  Metrics::count(PARSE_ERRORS);
 }
 
-void error(const Token& token, std::string_view message, bool& hadError) {
+inline void error(const Token& token, std::string_view message, bool& hadError) {
   if (token.type == END_OF_FILE) {
     report(" at end", message, hadError);
   } else {
@@ -21,13 +28,14 @@ void error(const Token& token, std::string_view message, bool& hadError) {
   }
 }
 
-void error(std::string_view message, bool& hadError) {
+inline void error(std::string_view message, bool& hadError) {
   report("", message, hadError);
 }
 
-void runtimeError(const RuntimeError& error, bool& hadRuntimeError) {
-  std::cerr <<
+inline void runtimeError(const RuntimeError& error, bool& hadRuntimeError) {
+  *errorStream <<
       "SNOL> " << error.what()
       << "\n";
   hadRuntimeError = true;
+  Metrics::count(RUNTIME_ERRORS);
 }
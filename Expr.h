@@ -1,14 +1,17 @@
 #pragma once
 
 #include <any>
+#include <cstddef>
 #include <memory>
 #include <utility>  // std::move
 #include <vector>
+#include "Natives.h"
 #include "Token.h"
 
 
 struct Assign;
 struct Binary;
+struct Call;
 struct Grouping;
 struct Literal;
 struct Unary;
@@ -17,6 +20,7 @@ struct Variable;
 struct ExprVisitor {
   virtual std::any visitAssignExpr(std::shared_ptr<Assign> expr) = 0;
   virtual std::any visitBinaryExpr(std::shared_ptr<Binary> expr) = 0;
+  virtual std::any visitCallExpr(std::shared_ptr<Call> expr) = 0;
   virtual std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) = 0;
   virtual std::any visitLiteralExpr(std::shared_ptr<Literal> expr) = 0;
   virtual std::any visitUnaryExpr(std::shared_ptr<Unary> expr) = 0;
@@ -24,21 +28,93 @@ struct ExprVisitor {
   virtual ~ExprVisitor() = default;
 };
 
+struct Expr;
+
+// One entry of walkPostfix's stack: a node, and whether its children have
+// been pushed above it yet.
+struct WalkFrame {
+  Expr* node;
+  bool expanded;
+};
+
 struct Expr {
   virtual std::any accept(ExprVisitor& visitor) = 0;
+
+  // Pushes the node's children onto frames, last child first, so that
+  // they come off the stack in source order. Returns false for a leaf.
+  virtual bool pushChildren(std::vector<WalkFrame>& frames) {
+    return false;
+  }
+
+protected:
+  // Called by the destructors of nodes with children. The children are
+  // queued, and the outermost destructor on the thread frees the queue in
+  // a loop, so destroying a deeply nested tree takes constant native
+  // stack. A node's members stop being const once its destruction begins.
+  template <class... Children>
+  static void release(const Children&... children) {
+    std::vector<std::shared_ptr<Expr>>& pending = orphans();
+    (queue(pending, const_cast<std::shared_ptr<Expr>&>(children)), ...);
+    drain(pending);
+  }
+
+  static void releaseAll(const std::vector<std::shared_ptr<Expr>>& children) {
+    std::vector<std::shared_ptr<Expr>>& pending = orphans();
+    for (const std::shared_ptr<Expr>& child : children) {
+      queue(pending, const_cast<std::shared_ptr<Expr>&>(child));
+    }
+    drain(pending);
+  }
+
+private:
+  static std::vector<std::shared_ptr<Expr>>& orphans() {
+    thread_local std::vector<std::shared_ptr<Expr>> pending;
+    return pending;
+  }
+
+  static void queue(std::vector<std::shared_ptr<Expr>>& pending,
+                    std::shared_ptr<Expr>& child) {
+    if (child) pending.push_back(std::move(child));
+  }
+
+  // Dropping a queued child may run its destructor, which queues its own
+  // children and returns; only the outermost call loops.
+  static void drain(std::vector<std::shared_ptr<Expr>>& pending) {
+    thread_local bool draining = false;
+    if (draining) return;
+    draining = true;
+    while (!pending.empty()) {
+      std::shared_ptr<Expr> child = std::move(pending.back());
+      pending.pop_back();
+    }
+    // Do not hold on to the queue of one huge tree.
+    if (pending.capacity() > 4096) pending.shrink_to_fit();
+    draining = false;
+  }
 };
 
 struct Assign: Expr, public std::enable_shared_from_this<Assign> {
-  Assign(Token name, std::shared_ptr<Expr> value)
-    : name{std::move(name)}, value{std::move(value)}
+  Assign(Token name, std::shared_ptr<Expr> value, bool formula = false)
+    : name{std::move(name)}, value{std::move(value)}, formula{formula}
   {}
 
+  ~Assign() {
+    release(value);
+  }
+
   std::any accept(ExprVisitor& visitor)override {
     return visitor.visitAssignExpr(shared_from_this());
   }
 
+  bool pushChildren(std::vector<WalkFrame>& frames) override {
+    frames.push_back({value.get(), false});
+    return true;
+  }
+
   const Token name;
   const std::shared_ptr<Expr> value;
+  // Bound with :=, so the value is recomputed when its inputs change.
+  const bool formula;
 };
 
 struct Binary: Expr, public std::enable_shared_from_this<Binary> {
@@ -46,24 +122,73 @@ struct Binary: Expr, public std::enable_shared_from_this<Binary> {
     : left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
   {}
 
+  ~Binary() {
+    release(left, right);
+  }
+
   std::any accept(ExprVisitor& visitor)override {
     return visitor.visitBinaryExpr(shared_from_this());
   }
 
+  bool pushChildren(std::vector<WalkFrame>& frames) override {
+    frames.push_back({right.get(), false});
+    frames.push_back({left.get(), false});
+    return true;
+  }
+
   const std::shared_ptr<Expr> left;
   const Token op;
   const std::shared_ptr<Expr> right;
 };
 
+struct Call: Expr, public std::enable_shared_from_this<Call> {
+  Call(Token callee, Token paren,
+       std::vector<std::shared_ptr<Expr>> arguments, const Native* native)
+    : callee{std::move(callee)}, paren{std::move(paren)},
+      arguments{std::move(arguments)}, native{native}
+  {}
+
+  ~Call() {
+    releaseAll(arguments);
+  }
+
+  std::any accept(ExprVisitor& visitor)override {
+    return visitor.visitCallExpr(shared_from_this());
+  }
+
+  bool pushChildren(std::vector<WalkFrame>& frames) override {
+    for (auto argument = arguments.rbegin(); argument != arguments.rend();
+         ++argument) {
+      frames.push_back({argument->get(), false});
+    }
+    return true;
+  }
+
+  const Token callee;
+  const Token paren;
+  const std::vector<std::shared_ptr<Expr>> arguments;
+  // Resolved by the parser; its arity matches arguments.
+  const Native* const native;
+};
+
 struct Grouping: Expr, public std::enable_shared_from_this<Grouping> {
   Grouping(std::shared_ptr<Expr> expression)
     : expression{std::move(expression)}
   {}
 
+  ~Grouping() {
+    release(expression);
+  }
+
   std::any accept(ExprVisitor& visitor)override {
     return visitor.visitGroupingExpr(shared_from_this());
   }
 
+  bool pushChildren(std::vector<WalkFrame>& frames) override {
+    frames.push_back({expression.get(), false});
+    return true;
+  }
+
   const std::shared_ptr<Expr> expression;
 };
 
@@ -84,10 +209,19 @@ struct Unary: Expr, public std::enable_shared_from_this<Unary> {
     : op{std::move(op)}, right{std::move(right)}
   {}
 
+  ~Unary() {
+    release(right);
+  }
+
   std::any accept(ExprVisitor& visitor)override {
     return visitor.visitUnaryExpr(shared_from_this());
   }
 
+  bool pushChildren(std::vector<WalkFrame>& frames) override {
+    frames.push_back({right.get(), false});
+    return true;
+  }
+
   const Token op;
   const std::shared_ptr<Expr> right;
 };
@@ -104,3 +238,28 @@ struct Variable: Expr, public std::enable_shared_from_this<Variable> {
   const Token name;
 };
 
+// Calls visit on every node of the tree under root, each after its
+// children, left to right. The walk is kept on frames instead of the
+// native stack, so trees of any depth can be walked. Callers keep one
+// frames vector to reuse its storage; visit may start a nested walk on
+// it, which only uses the frames above the current ones.
+template <class Visit>
+void walkPostfix(Expr& root, std::vector<WalkFrame>& frames, Visit visit) {
+  std::size_t base = frames.size();
+  frames.push_back({&root, false});
+  try {
+    while (frames.size() > base) {
+      WalkFrame& top = frames.back();
+      Expr& node = *top.node;
+      if (!top.expanded) {
+        top.expanded = true;
+        if (node.pushChildren(frames)) continue;
+      }
+      frames.pop_back();
+      visit(node);
+    }
+  } catch (...) {
+    frames.resize(base);
+    throw;
+  }
+}
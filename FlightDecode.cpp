@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <cstring>      // std::memcpy
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "FlightRecorder.h"
+
+// Prints a flight recorder dump written by SNOL --flight as text, one
+// event per line.
+
+std::string value(std::uint8_t type, std::uint64_t bits) {
+  if (type == VALUE_INT) {
+    return std::to_string(static_cast<std::int64_t>(bits));
+  }
+  if (type == VALUE_DOUBLE) {
+    double number;
+    std::memcpy(&number, &bits, sizeof(number));
+    return std::to_string(number);
+  }
+  return "-";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    std::cout << "Usage: FlightDecode dump\n";
+    return 64;
+  }
+
+  std::ifstream in{argv[1], std::ios::binary};
+  char header[sizeof(FLIGHT_MAGIC)];
+  std::uint64_t total;
+  in.read(header, sizeof(header));
+  in.read(reinterpret_cast<char*>(&total), sizeof(total));
+  if (!in || std::string_view{header, sizeof(header) - 1} != FLIGHT_MAGIC ||
+      header[sizeof(header) - 1] != FLIGHT_VERSION) {
+    std::cerr << argv[1] << " is not a SNOL flight recorder dump.\n";
+    return 65;
+  }
+
+  std::cout << total << " events recorded\n";
+  FlightEvent event;
+  while (in.read(reinterpret_cast<char*>(&event), sizeof(event))) {
+    std::cout << event.time / 1000.0 << "us ";
+    switch (event.kind) {
+      case STATEMENT_START:
+        std::cout << "statement start";
+        break;
+      case STATEMENT_END:
+        std::cout << "statement end";
+        break;
+      case VARIABLE_ASSIGN:
+        std::cout << "assign " << event.text << ": "
+            << value(event.oldType, event.oldValue) << " -> "
+            << value(event.newType, event.newValue);
+        break;
+      case PARSE_ERROR:
+        std::cout << "parse error: " << event.text;
+        break;
+      case RUNTIME_ERROR:
+        std::cout << "runtime error: " << event.text;
+        break;
+      default:
+        std::cout << "unknown event " << static_cast<int>(event.kind);
+    }
+    std::cout << "\n";
+  }
+}
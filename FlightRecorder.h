@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>    // std::min
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>      // std::memcpy, std::memset
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+enum FlightEventKind: std::uint8_t {
+  STATEMENT_START, STATEMENT_END, VARIABLE_ASSIGN, PARSE_ERROR, RUNTIME_ERROR,
+};
+
+enum FlightValueType: std::uint8_t {
+  VALUE_NONE, VALUE_INT, VALUE_DOUBLE,
+};
+
+// One fixed-size record. Values are stored as the raw bits of an int64 or
+// a double, tagged by their FlightValueType.
+struct FlightEvent {
+  std::uint64_t time;       // nanoseconds since the recorder was created
+  std::uint64_t oldValue;
+  std::uint64_t newValue;
+  std::uint8_t kind;
+  std::uint8_t oldType;
+  std::uint8_t newType;
+  char text[37];            // variable name or error message, truncated
+};
+
+static_assert(sizeof(FlightEvent) == 64);
+
+// A dump is "SNOLFLT", a version byte, the number of events recorded over
+// the recorder's lifetime as a u64, then the retained events oldest first.
+constexpr char FLIGHT_MAGIC[] = "SNOLFLT";
+constexpr char FLIGHT_VERSION = 1;
+
+// Set by the SIGUSR1 handler; interpreters poll it between statements.
+inline volatile std::sig_atomic_t flightDumpRequested = 0;
+
+// Keeps the most recent events of one interpreter in a ring buffer so
+// that the lead-up to a wrong value, a slow command or an error can be
+// inspected afterwards. Only the interpreter's thread records; recording
+// never blocks or allocates.
+class FlightRecorder {
+  const std::size_t capacity;  // a power of two
+  std::unique_ptr<FlightEvent[]> events;
+  std::atomic<std::uint64_t> recorded{0};
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+public:
+  // Where dumps triggered by errors or SIGUSR1 are written; empty disables
+  // them. dump() can always be called directly.
+  std::string dumpPath;
+
+  static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+  FlightRecorder(std::size_t capacity = DEFAULT_CAPACITY)
+    : capacity{roundUp(capacity)}, events{new FlightEvent[this->capacity]()}
+  {}
+
+  static void installSignalHandler() {
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, [](int) { flightDumpRequested = 1; });
+#endif
+  }
+
+  void statementStart() {
+    record(STATEMENT_START);
+  }
+
+  void statementEnd() {
+    record(STATEMENT_END);
+  }
+
+  void assign(std::string_view name, const std::any& oldValue,
+              const std::any& newValue) {
+    record(VARIABLE_ASSIGN, name, &oldValue, &newValue);
+  }
+
+  void error(FlightEventKind kind, std::string_view message) {
+    record(kind, message);
+  }
+
+  // Writes the retained events to path. Dumps taken while another thread
+  // is recording may contain a torn oldest event.
+  bool dump(const std::string& path) const {
+    std::uint64_t total = recorded.load(std::memory_order_acquire);
+    std::uint64_t count = std::min<std::uint64_t>(total, capacity);
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out.write(FLIGHT_MAGIC, sizeof(FLIGHT_MAGIC) - 1);
+    out.put(FLIGHT_VERSION);
+    out.write(reinterpret_cast<const char*>(&total), sizeof(total));
+    for (std::uint64_t i = total - count; i < total; ++i) {
+      out.write(reinterpret_cast<const char*>(&events[i & (capacity - 1)]),
+                sizeof(FlightEvent));
+    }
+    return static_cast<bool>(out);
+  }
+
+  // Writes a dump if one was requested by SIGUSR1.
+  void pollSignal() const {
+    if (flightDumpRequested) {
+      flightDumpRequested = 0;
+      if (!dumpPath.empty()) dump(dumpPath);
+    }
+  }
+
+private:
+  // Writes an event into the next slot, then publishes it, so dump() never
+  // counts an event whose values are still being written.
+  void record(FlightEventKind kind, std::string_view text = {},
+              const std::any* oldValue = nullptr,
+              const std::any* newValue = nullptr) {
+    std::uint64_t index = recorded.load(std::memory_order_relaxed);
+    FlightEvent& event = events[index & (capacity - 1)];
+    event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    event.kind = kind;
+    event.oldType = encode(oldValue, event.oldValue);
+    event.newType = encode(newValue, event.newValue);
+    std::size_t length = std::min(text.size(), sizeof(event.text) - 1);
+    // An empty view may have a null data(), which memcpy must not be given.
+    if (length) std::memcpy(event.text, text.data(), length);
+    std::memset(event.text + length, 0, sizeof(event.text) - length);
+    recorded.store(index + 1, std::memory_order_release);
+  }
+
+  static std::size_t roundUp(std::size_t capacity) {
+    std::size_t power = 1;
+    while (power < capacity) power <<= 1;
+    return power;
+  }
+
+  static std::uint8_t encode(const std::any* value, std::uint64_t& bits) {
+    if (value && value->type() == typeid(std::int64_t)) {
+      bits = static_cast<std::uint64_t>(std::any_cast<std::int64_t>(*value));
+      return VALUE_INT;
+    }
+    if (value && value->type() == typeid(double)) {
+      double number = std::any_cast<double>(*value);
+      std::memcpy(&bits, &number, sizeof(bits));
+      return VALUE_DOUBLE;
+    }
+    bits = 0;
+    return VALUE_NONE;
+  }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>    // std::min
+#include <cstddef>
+#include <iterator>     // std::make_move_iterator
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Error.h"
+#include "FlightRecorder.h"
+#include "Metrics.h"
+#include "Parser.h"
+#include "Scanner.h"
+#include "Stmt.h"
+#include "Token.h"
+
+// A command scanned and parsed away from the interpreter, with the error
+// output that produced so it can be written when the command's turn
+// comes.
+struct ParsedCommand {
+  std::vector<std::shared_ptr<Stmt>> statements;
+  std::string errors;
+  // The messages of the parse errors, for recordParseErrors.
+  std::vector<std::string> parseErrors;
+  bool hadScanError = false;
+  bool hadParseError = false;
+};
+
+struct ScannedCommand {
+  std::vector<Token> tokens;
+  std::string errors;
+  bool hadError = false;
+};
+
+// Redirects errorStream on this thread to a buffer while it exists.
+class ErrorCapture {
+  std::ostringstream errors;
+  std::ostream* previous = errorStream;
+
+public:
+  ErrorCapture() {
+    errorStream = &errors;
+  }
+
+  ~ErrorCapture() {
+    errorStream = previous;
+  }
+
+  std::string text() const {
+    return errors.str();
+  }
+};
+
+inline ScannedCommand scanCommand(std::string_view source) {
+  PhaseTimer timer{SCAN};
+  ScannedCommand command;
+  ErrorCapture errors;
+  Scanner scanner {source};
+  command.tokens = scanner.scanTokens(command.hadError);
+  command.errors = errors.text();
+  return command;
+}
+
+inline ParsedCommand parseCommand(ScannedCommand scanned) {
+  PhaseTimer timer{PARSE};
+  ParsedCommand command;
+  command.hadScanError = scanned.hadError;
+  ErrorCapture errors;
+  Parser parser{scanned.tokens};
+  command.statements = parser.parse(command.hadParseError);
+  command.errors = std::move(scanned.errors) + errors.text();
+  command.parseErrors = parser.errorMessages();
+  return command;
+}
+
+inline ParsedCommand parseCommand(std::string_view source) {
+  return parseCommand(scanCommand(source));
+}
+
+// Records the parse errors of a command in the flight recorder of the
+// interpreter that reached it. Commands may be parsed on other threads,
+// but only the interpreter's own thread may record.
+inline void recordParseErrors(const std::vector<std::string>& messages,
+                              FlightRecorder& recorder) {
+  for (const std::string& message : messages) {
+    recorder.error(PARSE_ERROR, message);
+  }
+}
+
+// Returns the number of REPEAT blocks line opens minus the number it
+// closes. Words are matched the way Scanner forms identifiers, so this
+// agrees with the parser without scanning the line.
+inline int blockDepthChange(std::string_view line) {
+  auto isAlpha = [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  };
+  auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+
+  int change = 0;
+  std::size_t i = 0;
+  while (i < line.size()) {
+    if (!isAlpha(line[i])) {
+      ++i;
+      continue;
+    }
+    std::size_t start = i;
+    while (i < line.size() && (isAlpha(line[i]) || isDigit(line[i]))) ++i;
+    std::string_view word = line.substr(start, i - start);
+    if (word == "REPEAT") ++change;
+    if (word == "END") --change;
+  }
+  return change;
+}
+
+// Calls f with each command of source, without its final line terminator.
+// A command is one line, or every line from one that opens a REPEAT block
+// through the one that closes it.
+template <class F>
+void forEachCommand(std::string_view source, F f) {
+  while (!source.empty()) {
+    std::size_t end = 0;
+    int depth = 0;
+    do {
+      std::size_t newline = std::min(source.find('\n', end), source.size());
+      depth += blockDepthChange(source.substr(end, newline - end));
+      end = newline;
+      if (end < source.size()) ++end;
+    } while (depth > 0 && end < source.size());
+
+    std::string_view command = source.substr(0, end);
+    source.remove_prefix(end);
+    if (!command.empty() && command.back() == '\n') command.remove_suffix(1);
+    f(command);
+  }
+}
+
+// Returns source up to the first line reading "EXIT!", which ends a
+// script.
+inline std::string_view untilExit(std::string_view source) {
+  std::size_t begin = 0;
+  while (begin < source.size()) {
+    std::size_t end = std::min(source.find('\n', begin), source.size());
+    if (source.substr(begin, end - begin) == "EXIT!") {
+      return source.substr(0, begin);
+    }
+    begin = end + 1;
+  }
+  return source;
+}
+
+// Scans and parses every command of source on up to threads threads.
+// Commands never depend on each other, so they are split into one run of
+// consecutive commands per thread, and the runs are joined back in order.
+// Only finding the command boundaries is sequential, and it is a cheap
+// word count. Errors stay with their commands, so the caller reports them
+// in source order no matter which thread finished first.
+inline std::vector<ParsedCommand> parseParallel(std::string_view source,
+                                         unsigned threads) {
+  std::vector<std::string_view> sources;
+  forEachCommand(source, [&sources](std::string_view command) {
+    sources.push_back(command);
+  });
+
+  std::size_t chunks = std::min<std::size_t>(threads, sources.size());
+  std::vector<std::vector<ParsedCommand>> parsed(chunks);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < chunks; ++i) {
+    std::size_t begin = sources.size() * i / chunks;
+    std::size_t end = sources.size() * (i + 1) / chunks;
+    workers.emplace_back([&sources, begin, end, &commands = parsed[i]] {
+      commands.reserve(end - begin);
+      for (std::size_t j = begin; j < end; ++j) {
+        commands.push_back(parseCommand(sources[j]));
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  std::vector<ParsedCommand> commands;
+  for (std::vector<ParsedCommand>& chunk : parsed) {
+    commands.insert(commands.end(), std::make_move_iterator(chunk.begin()),
+                    std::make_move_iterator(chunk.end()));
+  }
+  return commands;
+}
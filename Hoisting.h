@@ -0,0 +1,253 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>      // std::move
+#include <vector>
+#include "Expr.h"
+#include "RuntimeError.h"
+#include "Stmt.h"
+
+// Rewrites the body of a REPEAT block for one run of the block: each
+// largest subexpression whose value cannot change between iterations is
+// evaluated once, up front, and replaced with a Literal of its value.
+//
+// A subexpression is invariant if it assigns nothing and reads only
+// variables that the body never assigns and that hold plain values of the
+// session's own. Shared variables may be republished under a running loop
+// and formulas may be recomputed, so reading either is never hoisted. The
+// value of a formula assigned in the body is kept as written, since the
+// formula must go on naming its inputs.
+class LoopHoister: public ExprVisitor, public StmtVisitor {
+public:
+  using HoldsValue = std::function<bool(const std::string& name)>;
+  using Evaluate = std::function<std::any(const std::shared_ptr<Expr>&)>;
+
+private:
+  // A visited subexpression: the expression to use in its place, whether
+  // that differs from the original, and whether its value is invariant.
+  struct Item {
+    std::shared_ptr<Expr> expr;
+    bool changed;
+    bool invariant;
+  };
+
+  HoldsValue holdsValue;
+  Evaluate evaluate;
+  std::set<std::string> assigned;
+  std::vector<WalkFrame> frames;
+  std::vector<Item> items;
+  std::shared_ptr<Stmt> rewritten;
+  bool hoisted = false;
+
+public:
+  LoopHoister(HoldsValue holdsValue, Evaluate evaluate)
+    : holdsValue{std::move(holdsValue)}, evaluate{std::move(evaluate)}
+  {}
+
+  // Returns the rewritten body, or nothing if there is nothing to hoist or
+  // evaluating an invariant failed, in which case the original body should
+  // run and fail in its own time.
+  std::optional<std::vector<std::shared_ptr<Stmt>>> hoist(
+      const std::vector<std::shared_ptr<Stmt>>& body) {
+    collectAssigned(body);
+    std::vector<std::shared_ptr<Stmt>> result;
+    try {
+      result = rewriteBody(body);
+    } catch (const RuntimeError&) {
+      return std::nullopt;
+    }
+    if (!hoisted) return std::nullopt;
+    return result;
+  }
+
+  std::any visitExpressionStmt(
+      std::shared_ptr<Expression> stmt) override {
+    std::shared_ptr<Expr> expression = rewrite(stmt->expression);
+    rewritten = expression == stmt->expression
+        ? stmt : std::make_shared<Expression>(std::move(expression));
+    return {};
+  }
+
+  std::any visitPrintStmt(std::shared_ptr<Print> stmt) override {
+    std::shared_ptr<Expr> expression = rewrite(stmt->expression);
+    rewritten = expression == stmt->expression
+        ? stmt : std::make_shared<Print>(std::move(expression));
+    return {};
+  }
+
+  std::any visitBegStmt(std::shared_ptr<Beg> stmt) override {
+    rewritten = stmt;
+    return {};
+  }
+
+  std::any visitRepeatStmt(std::shared_ptr<Repeat> stmt) override {
+    std::shared_ptr<Expr> count = rewrite(stmt->count);
+    std::vector<std::shared_ptr<Stmt>> body = rewriteBody(stmt->body);
+    rewritten = count == stmt->count && body == stmt->body
+        ? stmt : std::make_shared<Repeat>(stmt->keyword, std::move(count),
+                                          std::move(body));
+    return {};
+  }
+
+  std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
+    Item value = take();
+    if (expr->formula) {
+      items.push_back({expr, false, false});
+      return {};
+    }
+
+    std::shared_ptr<Expr> settled = settle(value);
+    items.push_back({value.changed
+        ? std::make_shared<Assign>(expr->name, std::move(settled)) : expr,
+        value.changed, false});
+    return {};
+  }
+
+  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
+    Item right = take();
+    Item left = take();
+    if (left.invariant && right.invariant) {
+      items.push_back({expr, false, true});
+      return {};
+    }
+
+    std::shared_ptr<Expr> settledLeft = settle(left);
+    std::shared_ptr<Expr> settledRight = settle(right);
+    bool changed = left.changed || right.changed;
+    items.push_back({changed
+        ? std::make_shared<Binary>(std::move(settledLeft), expr->op,
+                                   std::move(settledRight))
+        : expr, changed, false});
+    return {};
+  }
+
+  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
+    std::size_t first = items.size() - expr->arguments.size();
+    bool invariant = true;
+    for (std::size_t i = first; i < items.size(); ++i) {
+      invariant = invariant && items[i].invariant;
+    }
+    if (invariant) {
+      items.resize(first);
+      items.push_back({expr, false, true});
+      return {};
+    }
+
+    std::vector<std::shared_ptr<Expr>> arguments;
+    bool changed = false;
+    for (std::size_t i = first; i < items.size(); ++i) {
+      arguments.push_back(settle(items[i]));
+      changed = changed || items[i].changed;
+    }
+    items.resize(first);
+    items.push_back({changed
+        ? std::make_shared<Call>(expr->callee, expr->paren,
+                                 std::move(arguments), expr->native)
+        : expr, changed, false});
+    return {};
+  }
+
+  std::any visitGroupingExpr(
+      std::shared_ptr<Grouping> expr) override {
+    Item& inner = items.back();
+    if (inner.changed) {
+      inner.expr = std::make_shared<Grouping>(inner.expr);
+    } else {
+      inner.expr = expr;
+    }
+    return {};
+  }
+
+  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+    items.push_back({expr, false, true});
+    return {};
+  }
+
+  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
+    Item& inner = items.back();
+    if (inner.changed) {
+      inner.expr = std::make_shared<Unary>(expr->op, inner.expr);
+    } else {
+      inner.expr = expr;
+    }
+    return {};
+  }
+
+  std::any visitVariableExpr(
+      std::shared_ptr<Variable> expr) override {
+    items.push_back({expr, false,
+        assigned.count(expr->name.lexeme) == 0 &&
+            holdsValue(expr->name.lexeme)});
+    return {};
+  }
+
+private:
+  std::vector<std::shared_ptr<Stmt>> rewriteBody(
+      const std::vector<std::shared_ptr<Stmt>>& body) {
+    std::vector<std::shared_ptr<Stmt>> result;
+    result.reserve(body.size());
+    for (const std::shared_ptr<Stmt>& statement : body) {
+      // Statements that failed to parse are left as they are.
+      if (!statement) {
+        result.push_back(statement);
+        continue;
+      }
+      statement->accept(*this);
+      result.push_back(std::move(rewritten));
+    }
+    return result;
+  }
+
+  // Returns expr with its invariant parts hoisted, or expr itself.
+  std::shared_ptr<Expr> rewrite(const std::shared_ptr<Expr>& expr) {
+    walkPostfix(*expr, frames, [this](Expr& node) { node.accept(*this); });
+    Item item = take();
+    return settle(item);
+  }
+
+  Item take() {
+    Item item = std::move(items.back());
+    items.pop_back();
+    return item;
+  }
+
+  // Returns the expression to use for item in a parent that is not
+  // invariant itself, evaluating item now if it is.
+  std::shared_ptr<Expr> settle(Item& item) {
+    if (!item.invariant || dynamic_cast<Literal*>(item.expr.get())) {
+      return item.expr;
+    }
+    item.changed = true;
+    hoisted = true;
+    return std::make_shared<Literal>(evaluate(item.expr));
+  }
+
+  void collectAssigned(const std::vector<std::shared_ptr<Stmt>>& body) {
+    for (const std::shared_ptr<Stmt>& statement : body) {
+      if (auto* expression = dynamic_cast<Expression*>(statement.get())) {
+        collectAssigned(*expression->expression);
+      } else if (auto* print = dynamic_cast<Print*>(statement.get())) {
+        collectAssigned(*print->expression);
+      } else if (auto* beg = dynamic_cast<Beg*>(statement.get())) {
+        assigned.insert(beg->name.lexeme);
+      } else if (auto* repeat = dynamic_cast<Repeat*>(statement.get())) {
+        collectAssigned(*repeat->count);
+        collectAssigned(repeat->body);
+      }
+    }
+  }
+
+  void collectAssigned(Expr& expr) {
+    walkPostfix(expr, frames, [this](Expr& node) {
+      if (auto* assign = dynamic_cast<Assign*>(&node)) {
+        assigned.insert(assign->name.lexeme);
+      }
+    });
+  }
+};
@@ -1,42 +1,177 @@
 #pragma once
 
+#include <algorithm>      // std::min
 #include <any>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>        // std::strtoll
+#include <cstring>        // std::strlen
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <utility>        // std::move
+#include "Arithmetic.h"
+#include "Dependencies.h"
 #include "Environment.h"
 #include "Error.h"
 #include "Expr.h"
+#include "FlightRecorder.h"
+#include "Hoisting.h"
+#include "Limits.h"
+#include "Metrics.h"
 #include "RuntimeError.h"
+#include "SharedEnvironment.h"
 #include "Stmt.h"
 
 class Interpreter: public ExprVisitor,
                    public StmtVisitor {
-  std::shared_ptr<Environment> environment{new Environment};
+  std::shared_ptr<Environment> environment;
+  FlightRecorder recorder;
   bool hadError = false;
 
+  // The step budget is spent in slices of at most CHECK_INTERVAL steps.
+  // Each step only decrements countdown; when a slice runs out,
+  // checkLimits() charges it to stepsLeft and reads the clock.
+  static constexpr std::uint64_t CHECK_INTERVAL = 1024;
+  // Shorter loops run their body as written.
+  static constexpr std::int64_t HOIST_MIN_ITERATIONS = 16;
+  std::uint64_t stepsLeft = UINT64_MAX;
+  std::uint64_t slice = CHECK_INTERVAL;
+  std::uint64_t countdown = CHECK_INTERVAL;
+  bool hasDeadline = false;
+  std::chrono::steady_clock::time_point deadline;
+  bool exceeded = false;
+
+  // The walks of the expressions being evaluated, and the values of their
+  // visited nodes that the parent nodes have yet to take. A nested
+  // evaluation, such as a formula recomputed on reading it, uses the
+  // entries above those of the evaluation it is nested in.
+  std::vector<WalkFrame> frames;
+  std::vector<std::any> values;
+
 public:
+  Interpreter(std::shared_ptr<SharedEnvironment> shared = nullptr,
+              std::size_t flightEvents = FlightRecorder::DEFAULT_CAPACITY)
+    : environment{std::make_shared<Environment>(std::move(shared))},
+      recorder{flightEvents}
+  {}
+
+  // Where PRINT output and BEG prompts are written.
+  std::ostream* output = &std::cout;
+
+  // Supplies the answers to BEG prompts; returns false when input is over.
+  std::function<bool(std::string&)> readLine = [](std::string& line) {
+    return static_cast<bool>(std::getline(std::cin, line));
+  };
+
+  FlightRecorder& flightRecorder() {
+    return recorder;
+  }
+
+  // Starts a new execution under limits, which apply until the next call.
+  void limit(const Limits& limits) {
+    environment->maxVariables = limits.maxVariables;
+    stepsLeft = limits.maxSteps != 0 ? limits.maxSteps : UINT64_MAX;
+    slice = countdown = std::min(stepsLeft, CHECK_INTERVAL);
+    hasDeadline = limits.timeout.count() > 0;
+    deadline = std::chrono::steady_clock::now() + limits.timeout;
+    exceeded = false;
+  }
+
+  // Whether the current execution hit one of its limits. Callers should
+  // stop running commands once it has.
+  bool limitExceeded() const {
+    return exceeded;
+  }
+
+  bool defined(const std::string& name) {
+    return environment->defined(name);
+  }
+
+  // Returns the value of a variable, recomputing it first if it is a
+  // formula whose inputs have changed. Stale formulas upstream of it are
+  // recomputed first, in order, so each evaluation finds its inputs fresh
+  // and chains of formulas do not recurse.
+  std::any lookup(const Token& name) {
+    for (Environment::StaleFormula& formula : environment->stale(name)) {
+      environment->refresh(formula.name, evaluate(formula.expression));
+    }
+    return environment->get(name);
+  }
+
+  void assign(const Token& name, std::any value) {
+    std::any old = environment->assign(name, value);
+    recorder.assign(name.lexeme, old, value);
+  }
+
   void interpret(const std::vector<
       std::shared_ptr<Stmt>>& statements) {
     try {
       for (const std::shared_ptr<Stmt>& statement : statements) {
         execute(statement);
       }
-    } catch (RuntimeError error) {
-      runtimeError(error, hadError);
+    } catch (const LimitError& error) {
+      exceeded = true;
+      fail(error);
+    } catch (const RuntimeError& error) {
+      fail(error);
     }
   }
 
 private:
-  std::any evaluate(std::shared_ptr<Expr> expr) {
-    return expr->accept(*this);
+  void fail(const RuntimeError& error) {
+    runtimeError(error, hadError);
+    recorder.error(RUNTIME_ERROR, error.what());
+    if (!recorder.dumpPath.empty()) recorder.dump(recorder.dumpPath);
   }
 
-  void execute(std::shared_ptr<Stmt> stmt) {
+  void step() {
+    if (countdown == 0) checkLimits();
+    --countdown;
+  }
+
+  void checkLimits() {
+    stepsLeft -= slice;
+    // Until a new slice is granted, every step lands here again.
+    slice = 0;
+    if (stepsLeft == 0) throw LimitError{"Error! Step limit exceeded!"};
+    if (hasDeadline && std::chrono::steady_clock::now() >= deadline) {
+      throw LimitError{"Error! Time limit exceeded!"};
+    }
+    slice = countdown = std::min(stepsLeft, CHECK_INTERVAL);
+  }
+
+  // Evaluates expr in postfix order without recursion, so expressions of
+  // any depth can be evaluated. Each visit method pops the values of the
+  // node's children off values and pushes the node's own.
+  std::any evaluate(const std::shared_ptr<Expr>& expr) {
+    std::size_t base = values.size();
+    try {
+      walkPostfix(*expr, frames, [this](Expr& node) {
+        step();
+        node.accept(*this);
+      });
+    } catch (...) {
+      values.resize(base);
+      throw;
+    }
+    std::any value = std::move(values.back());
+    values.pop_back();
+    return value;
+  }
+
+  void execute(const std::shared_ptr<Stmt>& stmt) {
+    step();
+    Metrics::count(STATEMENTS);
+    recorder.pollSignal();
+    recorder.statementStart();
     stmt->accept(*this);
+    recorder.statementEnd();
   }
 
 public:
@@ -47,8 +182,9 @@ public:
   }
 
   std::any visitPrintStmt(std::shared_ptr<Print> stmt) override {
+    Metrics::count(PRINTS);
     std::any value = evaluate(stmt->expression);
-    std::cout << "SNOL> " << stringify(value) << "\n";
+    *output << "SNOL> " << stringify(value) << "\n";
     return {};
   }
 
@@ -59,10 +195,14 @@ public:
     std::string line;
     char *temp;
 
-    std::cout << "SNOL> Please enter value for [" << stmt->name.lexeme << "]:\n";
+    Metrics::count(BEG_PROMPTS);
+    *output << "SNOL> Please enter value for [" << stmt->name.lexeme << "]:\n";
     while(!isNumber) {
-      std::cout << "Input: ";
-      std::getline(std::cin, line);
+      *output << "Input: ";
+      if (!readLine(line)) {
+        throw RuntimeError{stmt->name,
+            "Error! No input for [" + stmt->name.lexeme + "]!"};
+      }
 
       strtod(line.c_str(), &temp);
       if(!strlen(temp))
@@ -71,111 +211,170 @@ public:
         isInt = true;
       if(line[0] == '.')
         isNumber = false;
+      // Integers must fit in 64 bits.
+      if(isNumber && isInt) {
+        errno = 0;
+        std::strtoll(line.c_str(), nullptr, 10);
+        if (errno == ERANGE) isNumber = false;
+      }
       if(!isNumber)
-        std::cout << "\nSNOL> Must be an integer or float! Please enter again.\n";
+        *output << "\nSNOL> Must be an integer or float! Please enter again.\n";
     }
 
     if (isInt)
-      value = std::stoi(line);
+      value = static_cast<std::int64_t>(std::stoll(line));
     else
       value = std::stod(line);
 
-    environment->assign(stmt->name, std::move(value));
+    assign(stmt->name, std::move(value));
     return {};
   }
 
+  // The count is evaluated once, before the first iteration, and the body
+  // runs straight from the tree, so an iteration costs no more than its
+  // statements would unrolled, minus their scanning and parsing. A loop
+  // that runs long enough to repay rewriting its body first has its
+  // loop-invariant subexpressions hoisted out of it.
+  std::any visitRepeatStmt(std::shared_ptr<Repeat> stmt) override {
+    std::any count = evaluate(stmt->count);
+    if (count.type() != typeid(std::int64_t) ||
+        std::any_cast<std::int64_t>(count) < 0) {
+      throw RuntimeError{stmt->keyword,
+          "Error! REPEAT count must be a non-negative integer!"};
+    }
+    std::int64_t iterations = std::any_cast<std::int64_t>(count);
+
+    std::optional<std::vector<std::shared_ptr<Stmt>>> hoisted;
+    if (iterations >= HOIST_MIN_ITERATIONS) {
+      hoisted = LoopHoister{
+          [this](const std::string& name) {
+            return environment->holdsValue(name);
+          },
+          [this](const std::shared_ptr<Expr>& expr) {
+            return evaluate(expr);
+          }}.hoist(stmt->body);
+    }
+
+    const std::vector<std::shared_ptr<Stmt>>& body =
+        hoisted ? *hoisted : stmt->body;
+    for (std::int64_t i = iterations; i > 0; --i) {
+      for (const std::shared_ptr<Stmt>& statement : body) {
+        execute(statement);
+      }
+    }
+    return {};
+  }
+
+  // The value assigned stays on the stack as the assignment's own.
   std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
-    std::any value = evaluate(expr->value);
-    environment->assign(expr->name, value);
-    return value;
+    const std::any& value = values.back();
+    if (expr->formula) {
+      std::any old = environment->bind(expr->name, expr->value,
+                                       dependencies(expr->value), value);
+      recorder.assign(expr->name.lexeme, old, value);
+    } else {
+      assign(expr->name, value);
+    }
+    return {};
   }
 
   std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
-    std::any left = evaluate(expr->left);
-    std::any right = evaluate(expr->right);
-
-
-    if (left.type() == typeid(int) &&
-        right.type() == typeid(int)){
-      switch (expr->op.type) {
-        case MINUS:;
-          return std::any_cast<int>(left) -
-                std::any_cast<int>(right);
-        case PLUS:
-            return std::any_cast<int>(left) +
-                  std::any_cast<int>(right);
-        case SLASH:
-          return std::any_cast<int>(left) /
-                std::any_cast<int>(right);
-        case STAR:
-          return std::any_cast<int>(left) *
-                std::any_cast<int>(right);
-        case MODULO:
-          return std::any_cast<int>(left) %
-                std::any_cast<int>(right);
+    std::any right = std::move(values.back());
+    values.pop_back();
+    values.back() = arithmetic(values.back(), right, expr->op);
+    return {};
+  }
+
+  // Arguments are unboxed into a fixed array and passed straight to the
+  // native's int or double overload, which the parser already resolved.
+  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
+    const Native& native = *expr->native;
+    std::int64_t ints[MAX_NATIVE_ARITY];
+    double doubles[MAX_NATIVE_ARITY];
+    bool isInt = native.intFunction != nullptr;
+
+    std::size_t first = values.size() - expr->arguments.size();
+    for (std::size_t i = 0; i < expr->arguments.size(); ++i) {
+      const std::any& value = values[first + i];
+      checkNumberOperand(expr->paren, value);
+      bool argumentIsInt = value.type() == typeid(std::int64_t);
+      if (i == 0) {
+        isInt = argumentIsInt;
+      } else if (argumentIsInt != isInt) {
+        throw RuntimeError{expr->paren,
+            "Arguments must be of the same type in a function call!"};
       }
-    }
-    else if (left.type() == typeid(double) &&
-        right.type() == typeid(double)){
-      switch (expr->op.type) {
-        case MINUS:;
-          return std::any_cast<double>(left) -
-                std::any_cast<double>(right);
-        case PLUS:
-            return std::any_cast<double>(left) +
-                  std::any_cast<double>(right);
-        case SLASH:
-          return std::any_cast<double>(left) /
-                std::any_cast<double>(right);
-        case STAR:
-          return std::any_cast<double>(left) *
-                std::any_cast<double>(right);
-        case MODULO:
-          throw RuntimeError{expr->op,
-              "Operands must be of the same type in an arithmetic operation!"};
 
+      if (isInt) {
+        ints[i] = std::any_cast<std::int64_t>(value);
+      } else {
+        doubles[i] = std::any_cast<double>(value);
       }
     }
-    else{
-      throw RuntimeError{expr->op,
-          "Operands must be of the same type in an arithmetic operation!"};
+
+    if (isInt ? !native.intFunction : !native.doubleFunction) {
+      throw RuntimeError{expr->callee, "Error! [" + native.name +
+          "] does not take " + (isInt ? "integer" : "float") + " arguments!"};
     }
 
-    // Unreachable.
+    std::any result;
+    try {
+      if (isInt) {
+        result = native.intFunction(ints);
+      } else {
+        result = native.doubleFunction(doubles);
+      }
+    } catch (const NativeError& error) {
+      throw RuntimeError{expr->paren, error.message};
+    }
+    values.resize(first);
+    values.push_back(std::move(result));
     return {};
   }
 
   std::any visitGroupingExpr(
       std::shared_ptr<Grouping> expr) override {
-    return evaluate(expr->expression);
+    return {};
   }
 
   std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
-    return expr->value;
+    values.push_back(expr->value);
+    return {};
   }
 
   std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
-    std::any right = evaluate(expr->right);
-    switch (expr->op.type) {
-      case MINUS:
-        checkNumberOperand(expr->op, right);
-        if (right.type() == typeid(int)) return -std::any_cast<int>(right);
-        if (right.type() == typeid(double)) return -std::any_cast<double>(right);
-    }
-
-    // Unreachable.
+    values.back() = negate(expr->op, values.back());
     return {};
   }
 
   std::any visitVariableExpr(
       std::shared_ptr<Variable> expr) override {
-    return environment->get(expr->name);
+    std::any value = lookup(expr->name);
+    values.push_back(std::move(value));
+    return {};
   }
 
 private:
+  std::any negate(const Token& op, const std::any& value) {
+    checkNumberOperand(op, value);
+    if (value.type() == typeid(std::int64_t)) {
+      return negate(op, std::any_cast<std::int64_t>(value));
+    }
+    return negate(op, std::any_cast<double>(value));
+  }
+
+  template <class T>
+  T negate(const Token& op, T value) {
+    T result{};
+    if (const char* error = negateKernel(value, result)) {
+      throw RuntimeError{op, error};
+    }
+    return result;
+  }
+
   void checkNumberOperand(const Token& op,
                           const std::any& operand) {
-    if (operand.type() == typeid(int)) return;
+    if (operand.type() == typeid(std::int64_t)) return;
     if (operand.type() == typeid(double)) return;
     throw RuntimeError{op, "Operand must be a number."};
   }
@@ -201,9 +400,9 @@ private:
   std::string stringify(const std::any& object) {
     if (object.type() == typeid(nullptr)) return "null";
 
-    if (object.type() == typeid(int)) {
+    if (object.type() == typeid(std::int64_t)) {
       std::string text = std::to_string(
-          std::any_cast<int>(object));
+          std::any_cast<std::int64_t>(object));
       return text;
     }
 
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "RuntimeError.h"
+#include "Token.h"
+
+// Bounds on one execution, so that a runaway or oversized script cannot
+// hold an interpreter indefinitely. Zero means no limit.
+struct Limits {
+  // Statements executed plus expressions evaluated.
+  std::uint64_t maxSteps = 0;
+  // Variables defined in the session's own environment.
+  std::size_t maxVariables = 0;
+  std::chrono::milliseconds timeout{0};
+};
+
+// Raised when an execution exceeds one of its Limits. It is reported like
+// any runtime error, but also ends the execution instead of only the
+// current command.
+class LimitError: public RuntimeError {
+public:
+  LimitError(std::string_view message)
+    : RuntimeError{noToken(), message}
+  {}
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>       // std::rename
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>      // std::move
+#include <vector>
+
+enum Counter {
+  STATEMENTS, PRINTS, BEG_PROMPTS, PARSE_ERRORS, RUNTIME_ERRORS,
+
+  COUNTER_COUNT,
+};
+
+enum Phase {
+  SCAN, PARSE, EXECUTE,
+
+  PHASE_COUNT,
+};
+
+// Upper bounds of the latency histogram buckets, in seconds.
+constexpr double LATENCY_BOUNDS[] = {
+  1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1.0, 10.0,
+};
+constexpr int BUCKET_COUNT = sizeof(LATENCY_BOUNDS) / sizeof(double) + 1;
+
+// Process-wide interpreter metrics. Each thread updates its own shard, so
+// recording is an uncontended relaxed load and store; the exporter sums
+// the shards when it renders them. When a thread exits, its counts are
+// folded into a retired total and its shard is cleared for the next new
+// thread, so a server that starts a thread per session keeps only as many
+// shards as it ever ran threads at once.
+class Metrics {
+  struct Shard {
+    std::atomic<std::uint64_t> counters[COUNTER_COUNT]{};
+    std::atomic<std::uint64_t> buckets[PHASE_COUNT][BUCKET_COUNT]{};
+    std::atomic<std::uint64_t> nanoseconds[PHASE_COUNT]{};
+    std::atomic<std::int64_t> liveVariables{0};
+
+    void clear() {
+      for (auto& counter : counters) counter.store(0);
+      for (auto& phase : buckets) {
+        for (auto& bucket : phase) bucket.store(0);
+      }
+      for (auto& total : nanoseconds) total.store(0);
+      liveVariables.store(0);
+    }
+  };
+
+  struct Totals {
+    std::uint64_t counters[COUNTER_COUNT] = {};
+    std::uint64_t buckets[PHASE_COUNT][BUCKET_COUNT] = {};
+    std::uint64_t nanoseconds[PHASE_COUNT] = {};
+    std::int64_t liveVariables = 0;
+
+    void add(const Shard& shard) {
+      for (int i = 0; i < COUNTER_COUNT; ++i) {
+        counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+      }
+      for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+          buckets[phase][i] +=
+              shard.buckets[phase][i].load(std::memory_order_relaxed);
+        }
+        nanoseconds[phase] +=
+            shard.nanoseconds[phase].load(std::memory_order_relaxed);
+      }
+      liveVariables += shard.liveVariables.load(std::memory_order_relaxed);
+    }
+  };
+
+  // Hands a thread's shard back to the registry when the thread exits.
+  struct Lease {
+    Shard* shard = instance().acquire();
+
+    ~Lease() {
+      instance().release(shard);
+    }
+  };
+
+  std::mutex mutex;
+  // Every shard, whether a thread holds it or it is free.
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<Shard*> freeShards;
+  // The counts of threads that have exited.
+  Totals retired;
+
+public:
+  static Metrics& instance() {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  static void count(Counter counter) {
+    bump(local().counters[counter], 1);
+  }
+
+  static void variablesChanged(std::int64_t delta) {
+    std::atomic<std::int64_t>& live = local().liveVariables;
+    live.store(live.load(std::memory_order_relaxed) + delta,
+               std::memory_order_relaxed);
+  }
+
+  static void observe(Phase phase, std::chrono::nanoseconds elapsed) {
+    Shard& shard = local();
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && seconds > LATENCY_BOUNDS[bucket]) {
+      ++bucket;
+    }
+    bump(shard.buckets[phase][bucket], 1);
+    bump(shard.nanoseconds[phase], elapsed.count());
+  }
+
+  // Renders every metric in the OpenMetrics text format.
+  std::string render() {
+    Totals totals;
+    {
+      // Retiring a shard holds the mutex too, so no count is missed or
+      // added twice.
+      std::lock_guard<std::mutex> lock{mutex};
+      totals = retired;
+      for (const std::unique_ptr<Shard>& shard : shards) totals.add(*shard);
+    }
+
+    std::ostringstream out;
+    out << "# TYPE snol_statements counter\n"
+        << "snol_statements_total " << totals.counters[STATEMENTS] << "\n"
+        << "# TYPE snol_prints counter\n"
+        << "snol_prints_total " << totals.counters[PRINTS] << "\n"
+        << "# TYPE snol_beg_prompts counter\n"
+        << "snol_beg_prompts_total " << totals.counters[BEG_PROMPTS] << "\n"
+        << "# TYPE snol_errors counter\n"
+        << "snol_errors_total{kind=\"parse\"} "
+        << totals.counters[PARSE_ERRORS] << "\n"
+        << "snol_errors_total{kind=\"runtime\"} "
+        << totals.counters[RUNTIME_ERRORS] << "\n"
+        << "# TYPE snol_live_variables gauge\n"
+        << "snol_live_variables " << totals.liveVariables << "\n"
+        << "# TYPE snol_phase_seconds histogram\n";
+
+    static const char* const phases[] = {"scan", "parse", "execute"};
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+      std::uint64_t cumulative = 0;
+      for (int i = 0; i < BUCKET_COUNT; ++i) {
+        cumulative += totals.buckets[phase][i];
+        out << "snol_phase_seconds_bucket{phase=\"" << phases[phase]
+            << "\",le=\"";
+        if (i < BUCKET_COUNT - 1) {
+          out << LATENCY_BOUNDS[i];
+        } else {
+          out << "+Inf";
+        }
+        out << "\"} " << cumulative << "\n";
+      }
+      out << "snol_phase_seconds_sum{phase=\"" << phases[phase] << "\"} "
+          << totals.nanoseconds[phase] / 1e9 << "\n"
+          << "snol_phase_seconds_count{phase=\"" << phases[phase] << "\"} "
+          << cumulative << "\n";
+    }
+    out << "# EOF\n";
+    return out.str();
+  }
+
+private:
+  Metrics() = default;
+
+  static Shard& local() {
+    thread_local Lease lease;
+    return *lease.shard;
+  }
+
+  Shard* acquire() {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (!freeShards.empty()) {
+      Shard* shard = freeShards.back();
+      freeShards.pop_back();
+      return shard;
+    }
+    shards.push_back(std::make_unique<Shard>());
+    return shards.back().get();
+  }
+
+  void release(Shard* shard) {
+    std::lock_guard<std::mutex> lock{mutex};
+    retired.add(*shard);
+    shard->clear();
+    freeShards.push_back(shard);
+  }
+
+  // Only the owning thread writes a shard, so no read-modify-write is needed.
+  static void bump(std::atomic<std::uint64_t>& value, std::uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+  }
+};
+
+// Times a phase from construction to destruction.
+class PhaseTimer {
+  Phase phase;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+public:
+  PhaseTimer(Phase phase)
+    : phase{phase}
+  {}
+
+  ~PhaseTimer() {
+    Metrics::observe(phase, std::chrono::steady_clock::now() - start);
+  }
+};
+
+// Rewrites an OpenMetrics text file on a background thread at a fixed
+// interval, and once more when destroyed. The file is replaced atomically
+// so a scraper never sees a partial write.
+class MetricsExporter {
+  std::string path;
+  std::chrono::milliseconds interval;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread thread;
+
+public:
+  MetricsExporter(std::string path, std::chrono::milliseconds interval)
+    : path{std::move(path)}, interval{interval},
+      thread{[this] { run(); }}
+  {}
+
+  ~MetricsExporter() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    write();
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+      write();
+    }
+  }
+
+  void write() {
+    std::string temporary = path + ".tmp";
+    {
+      std::ofstream file{temporary, std::ios::trunc};
+      file << Metrics::instance().render();
+      if (!file) return;
+    }
+    std::rename(temporary.c_str(), path.c_str());
+  }
+};
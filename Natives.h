@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>    // std::min, std::max
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>      // std::abs
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>      // std::move
+#include "Arithmetic.h"
+
+constexpr int MAX_NATIVE_ARITY = 8;
+
+// A function implemented in C++. SNOL keeps ints and doubles apart, so a
+// native has at most one overload for each: all arguments are ints, or all
+// are doubles. Arguments arrive unboxed in an array of arity elements.
+struct Native {
+  using IntFunction = std::int64_t (*)(const std::int64_t* args);
+  using DoubleFunction = double (*)(const double* args);
+
+  std::string name;
+  int arity;
+  IntFunction intFunction;        // nullptr if ints are not accepted
+  DoubleFunction doubleFunction;  // nullptr if doubles are not accepted
+};
+
+// Thrown by a native whose arguments have no result, such as an integer
+// that overflows. It is reported at the call like any runtime error.
+struct NativeError {
+  const char* message;
+};
+
+// The functions SNOL programs can call. Calls are resolved against it when
+// they are parsed, so natives must be defined before parsing the code that
+// uses them, and not while other threads parse.
+class NativeRegistry {
+  // std::map never moves its elements, so parsed calls can keep pointers.
+  std::map<std::string, Native> natives;
+
+public:
+  static NativeRegistry& instance() {
+    static NativeRegistry registry{builtins()};
+    return registry;
+  }
+
+  void define(std::string name, int arity, Native::IntFunction intFunction,
+              Native::DoubleFunction doubleFunction) {
+    if (arity < 0 || arity > MAX_NATIVE_ARITY) {
+      throw std::invalid_argument{"Natives take at most " +
+          std::to_string(MAX_NATIVE_ARITY) + " arguments."};
+    }
+    if (!intFunction && !doubleFunction) {
+      throw std::invalid_argument{"Native " + name + " has no overload."};
+    }
+
+    // Parsed calls point at their entry, so an entry is never replaced.
+    if (natives.count(name)) {
+      throw std::invalid_argument{"Native " + name + " is already defined."};
+    }
+    natives.emplace(name, Native{name, arity, intFunction, doubleFunction});
+  }
+
+  const Native* find(const std::string& name) const {
+    auto native = natives.find(name);
+    return native == natives.end() ? nullptr : &native->second;
+  }
+
+private:
+  static NativeRegistry builtins() {
+    NativeRegistry registry;
+    registry.define("sqrt", 1, nullptr,
+        [](const double* args) { return std::sqrt(args[0]); });
+    registry.define("pow", 2, nullptr,
+        [](const double* args) { return std::pow(args[0], args[1]); });
+    registry.define("abs", 1,
+        [](const std::int64_t* args) {
+          std::int64_t result = args[0];
+          if (result < 0) {
+            if (const char* error = negateKernel(args[0], result)) {
+              throw NativeError{error};
+            }
+          }
+          return result;
+        },
+        [](const double* args) { return std::fabs(args[0]); });
+    registry.define("min", 2,
+        [](const std::int64_t* args) { return std::min(args[0], args[1]); },
+        [](const double* args) { return std::min(args[0], args[1]); });
+    registry.define("max", 2,
+        [](const std::int64_t* args) { return std::max(args[0], args[1]); },
+        [](const double* args) { return std::max(args[0], args[1]); });
+    return registry;
+  }
+};
@@ -0,0 +1,94 @@
+// Times scanning, parsing, running and freeing expressions nested depth
+// levels deep (a million by default):
+//   ./NestingBench [depth]
+#include <chrono>
+#include <cstdlib>      // std::strtoull
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Error.h"
+#include "Interpreter.h"
+#include "Parser.h"
+#include "Scanner.h"
+#include "Stmt.h"
+#include "Token.h"
+
+namespace {
+
+std::string repeat(const std::string& text, std::size_t count) {
+  std::string result;
+  result.reserve(text.size() * count);
+  for (std::size_t i = 0; i < count; ++i) result += text;
+  return result;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+void bench(const std::string& name, const std::string& source) {
+  std::ostringstream output;
+  std::ostream* previous = errorStream;
+  errorStream = &output;
+
+  auto start = std::chrono::steady_clock::now();
+  bool hadError = false;
+  std::vector<Token> tokens = Scanner{source}.scanTokens(hadError);
+  double scan = millisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<Stmt>> statements;
+  {
+    Parser parser{tokens};
+    statements = parser.parse(hadError);
+  }
+  double parse = millisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  if (!hadError) {
+    Interpreter interpreter{};
+    interpreter.output = &output;
+    interpreter.interpret(statements);
+  }
+  double run = millisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  statements.clear();
+  double free = millisecondsSince(start);
+
+  errorStream = previous;
+  std::string result = output.str();
+  result = result.substr(0, result.find('\n'));
+  std::cout << std::left << std::setw(14) << name << std::right
+      << std::fixed << std::setprecision(1)
+      << std::setw(10) << scan << std::setw(10) << parse
+      << std::setw(10) << run << std::setw(10) << free
+      << "  " << result << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t depth = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+  std::cout << "depth " << depth << ", times in ms\n"
+      << std::left << std::setw(14) << "case" << std::right
+      << std::setw(10) << "scan" << std::setw(10) << "parse"
+      << std::setw(10) << "run" << std::setw(10) << "free"
+      << "  result\n";
+  bench("parentheses",
+        "PRINT " + repeat("(", depth) + "1" + repeat(")", depth));
+  bench("unary minus", "PRINT " + repeat("-", depth) + "1");
+  bench("mixed", "PRINT " + repeat("-(", depth) + "1" + repeat(")", depth));
+  bench("parse error",
+        "PRINT " + repeat("(", depth) + "1" + repeat(")", depth - 1));
+  bench("sum", "PRINT 1" + repeat("+1", depth));
+  bench("operators",
+        "PRINT " + repeat("(1+", depth) + "1" + repeat(")", depth));
+  bench("calls", "PRINT " + repeat("abs(", depth) + "1" + repeat(")", depth));
+  bench("assignments", repeat("a = ", depth) + "1\nPRINT a");
+}
@@ -0,0 +1,58 @@
+// Times parseParallel on 1, 2, 4 and 8 threads over a generated script of
+// assignments, formulas, prints and REPEAT blocks (200,000 lines by
+// default):
+//   ./ParallelParseBench [lines]
+#include <chrono>
+#include <cstdlib>      // std::strtoull
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Frontend.h"
+
+namespace {
+
+std::string generate(std::size_t lines) {
+  std::string source;
+  for (std::size_t i = 0; i < lines; ++i) {
+    std::string n = std::to_string(i);
+    std::string x = "x" + std::to_string(i % 100);
+    switch (i % 8) {
+      case 0: source += x + " = (a + b * " + n + ") % 7 - -c\n"; break;
+      case 1: source += x + " := sqrt(1.5 * y) + " + n + ".25\n"; break;
+      case 2: source += "PRINT " + x + " + min(a, " + n + ")\n"; break;
+      case 3: source += "REPEAT 3\n"; break;
+      case 4: source += x + " = " + x + " + 1\n"; break;
+      case 5: source += "PRINT abs(" + x + " - " + n + ")\n"; break;
+      case 6: source += "END\n"; break;
+      default: source += x + " = pow(2.0, 0.5) * " + n + ".0\n"; break;
+    }
+  }
+  return source;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t lines = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  std::string source = generate(lines);
+
+  std::cout << lines << " lines, " << source.size() / 1000000.0 << " MB, "
+      << std::thread::hardware_concurrency() << " hardware threads\n"
+      << std::setw(8) << "threads" << std::setw(10) << "ms"
+      << std::setw(10) << "MB/s" << std::setw(10) << "speedup" << "\n";
+  double single = 0;
+  for (unsigned threads : {1u, 2u, 4u, 8u}) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ParsedCommand> commands = parseParallel(source, threads);
+    double milliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (threads == 1) single = milliseconds;
+
+    std::cout << std::fixed << std::setprecision(1)
+        << std::setw(8) << threads << std::setw(10) << milliseconds
+        << std::setw(10) << source.size() / 1000.0 / milliseconds
+        << std::setw(10) << single / milliseconds << "\n";
+  }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <iterator>     // std::make_move_iterator
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -9,6 +10,7 @@
 #include <vector>
 #include "Error.h"
 #include "Expr.h"
+#include "Natives.h"
 #include "Stmt.h"
 #include "Token.h"
 #include "TokenType.h"
@@ -19,17 +21,31 @@ class Parser {
   };
 
   const std::vector<Token>& tokens;
+  // The message of every error reported, for the flight recorder of
+  // whichever interpreter reaches the command.
+  std::vector<std::string> messages;
   int current = 0;
   bool hadError = false;
+  // How many REPEAT blocks enclose the current token.
+  int repeatDepth = 0;
 
 public:
   Parser(const std::vector<Token>& tokens)
     : tokens{tokens}
   {}
 
+  const std::vector<std::string>& errorMessages() const {
+    return messages;
+  }
+
   std::vector<std::shared_ptr<Stmt>> parse(bool& fromError) {
     std::vector<std::shared_ptr<Stmt>> statements;
     while (!isAtEnd()) {
+      if (match(NEWLINE)) continue;
+      if (match(END)) {
+        error(previous(), "END without REPEAT!");
+        continue;
+      }
       // statements.push_back(statement());
       statements.push_back(declaration());
     }
@@ -40,10 +56,6 @@ public:
   }
 
 private:
-  std::shared_ptr<Expr> expression() {
-    return assignment();
-  }
-
   std::shared_ptr<Stmt> declaration() {
     try {
       if (match(BEG)) return begDeclaration();
@@ -57,6 +69,7 @@ private:
 
   std::shared_ptr<Stmt> statement() {
     if (match(PRINT)) return printStatement();
+    if (match(REPEAT)) return repeatStatement();
 
     return expressionStatement();
   }
@@ -69,6 +82,40 @@ private:
     return std::make_shared<Print>(value);
   }
 
+  std::shared_ptr<Stmt> repeatStatement() {
+    Token keyword = previous();
+    if (repeatDepth == MAX_REPEAT_DEPTH) {
+      // Skip to the block's END, so that one error covers all of it.
+      for (int open = 1; open > 0 && !isAtEnd();) {
+        if (match(REPEAT)) {
+          ++open;
+        } else if (match(END)) {
+          --open;
+        } else {
+          advance();
+        }
+      }
+      throw error(keyword, "REPEAT blocks are nested too deeply!");
+    }
+
+    struct Nesting {
+      int& depth;
+      Nesting(int& depth) : depth{++depth} {}
+      ~Nesting() { --depth; }
+    } nesting{repeatDepth};
+    std::shared_ptr<Expr> count = expression();
+
+    std::vector<std::shared_ptr<Stmt>> body;
+    while (!match(END)) {
+      if (isAtEnd()) throw error(peek(), "Expect END after REPEAT block.");
+      if (match(NEWLINE)) continue;
+      body.push_back(declaration());
+    }
+
+    return std::make_shared<Repeat>(std::move(keyword), std::move(count),
+                                    std::move(body));
+  }
+
   std::shared_ptr<Stmt> begDeclaration() {
     Token name = consume(IDENTIFIER, "Expect variable name.");
 
@@ -90,68 +137,163 @@ private:
     return std::make_shared<Expression>(expr);
   }
 
-  std::shared_ptr<Expr> assignment() {
-    std::shared_ptr<Expr> expr = equality();
+  // Expressions are parsed by operator precedence with explicit stacks, so
+  // deeply nested input costs heap space instead of native stack frames.
+  // The resulting tree and error reports match a recursive descent over
+  //   assignment -> term -> factor -> unary -> call -> primary.
+  struct Pending {
+    // Open parentheses and argument lists are barriers to reduce().
+    enum Kind { GROUP, CALL, ASSIGN, BINARY, UNARY };
+
+    Kind kind;
+    int precedence;
+    Token op;           // the callee of a CALL
+    int arguments = 0;  // commas seen so far in a CALL
+  };
 
-    if (match(EQUAL)) {
-      Token equals = previous();
-      std::shared_ptr<Expr> value = assignment();
+  static constexpr int ASSIGNMENT_PRECEDENCE = 1;
+  static constexpr int TERM_PRECEDENCE = 2;
+  static constexpr int FACTOR_PRECEDENCE = 3;
+  static constexpr int UNARY_PRECEDENCE = 4;
 
-      if (Variable* e = dynamic_cast<Variable*>(expr.get())) {
-        Token name = e->name;
-        return std::make_shared<Assign>(std::move(name), value);
+  std::shared_ptr<Expr> expression() {
+    std::vector<std::shared_ptr<Expr>> operands;
+    std::vector<Pending> operators;
+    int openGroups = 0;
+
+    for (;;) {
+      // Operand position: any prefix operators, then a primary.
+      std::shared_ptr<Expr> operand;
+      while (!operand) {
+        if (match(MINUS)) {
+          operators.push_back({Pending::UNARY, UNARY_PRECEDENCE, previous()});
+        } else if (match(LEFT_PAREN)) {
+          operators.push_back({Pending::GROUP, 0, previous()});
+          ++openGroups;
+        } else if (check(IDENTIFIER) && checkNext(LEFT_PAREN)) {
+          Token callee = advance();
+          advance();
+          if (match(RIGHT_PAREN)) {
+            operand = call(std::move(callee), previous(), {});
+          } else {
+            operators.push_back({Pending::CALL, 0, std::move(callee)});
+            ++openGroups;
+          }
+        } else {
+          operand = primary();
+        }
+      }
+      operands.push_back(std::move(operand));
+
+      // Operator position: close groups until an infix operator or the end.
+      for (;;) {
+        if (match(MINUS, PLUS)) {
+          reduce(operands, operators, TERM_PRECEDENCE);
+          operators.push_back({Pending::BINARY, TERM_PRECEDENCE, previous()});
+          break;
+        }
+
+        if (match(SLASH, STAR, MODULO)) {
+          reduce(operands, operators, FACTOR_PRECEDENCE);
+          operators.push_back({Pending::BINARY, FACTOR_PRECEDENCE, previous()});
+          break;
+        }
+
+        if (match(EQUAL, COLON_EQUAL)) {
+          // Assignment is right-associative.
+          reduce(operands, operators, ASSIGNMENT_PRECEDENCE + 1);
+          operators.push_back(
+              {Pending::ASSIGN, ASSIGNMENT_PRECEDENCE, previous()});
+          break;
+        }
+
+        reduce(operands, operators, ASSIGNMENT_PRECEDENCE);
+        if (openGroups == 0) return operands.back();
+
+        if (operators.back().kind == Pending::CALL) {
+          if (match(COMMA)) {
+            ++operators.back().arguments;
+            break;
+          }
+
+          Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
+          Token callee = operators.back().op;
+          std::size_t count = operators.back().arguments + 1;
+          operators.pop_back();
+          --openGroups;
+
+          std::vector<std::shared_ptr<Expr>> arguments(
+              std::make_move_iterator(operands.end() - count),
+              std::make_move_iterator(operands.end()));
+          operands.resize(operands.size() - count);
+          operands.push_back(
+              call(std::move(callee), paren, std::move(arguments)));
+          continue;
+        }
+
+        consume(RIGHT_PAREN, "Expect ')' after expression.");
+        operators.pop_back();
+        --openGroups;
+        operands.back() = std::make_shared<Grouping>(operands.back());
       }
-
-      error(std::move(equals), "Invalid assignment target.");
     }
-
-    return expr;
   }
 
-  std::shared_ptr<Expr> equality() {
-    std::shared_ptr<Expr> expr = comparison();
-
-    return expr;
-  }
-
-  std::shared_ptr<Expr> comparison() {
-    std::shared_ptr<Expr> expr = term();
-
-    return expr;
-  }
-
-  std::shared_ptr<Expr> term() {
-    std::shared_ptr<Expr> expr = factor();
-
-    while (match(MINUS, PLUS)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = factor();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+  // Pops operators binding at least as tightly as minPrecedence, stopping at
+  // the innermost open parenthesis.
+  void reduce(std::vector<std::shared_ptr<Expr>>& operands,
+              std::vector<Pending>& operators, int minPrecedence) {
+    while (!operators.empty() &&
+           operators.back().kind != Pending::GROUP &&
+           operators.back().kind != Pending::CALL &&
+           operators.back().precedence >= minPrecedence) {
+      Pending pending = operators.back();
+      operators.pop_back();
+      std::shared_ptr<Expr> right = std::move(operands.back());
+      operands.pop_back();
+
+      switch (pending.kind) {
+        case Pending::UNARY:
+          operands.push_back(
+              std::make_shared<Unary>(pending.op, std::move(right)));
+          break;
+        case Pending::BINARY:
+          operands.back() = std::make_shared<Binary>(
+              operands.back(), pending.op, std::move(right));
+          break;
+        case Pending::ASSIGN:
+          if (Variable* e = dynamic_cast<Variable*>(operands.back().get())) {
+            Token name = e->name;
+            operands.back() = std::make_shared<Assign>(std::move(name),
+                std::move(right), pending.op.type == COLON_EQUAL);
+          } else {
+            error(pending.op, "Invalid assignment target.");
+          }
+          break;
+        case Pending::GROUP:
+        case Pending::CALL:
+          break;
+      }
     }
-
-    return expr;
   }
 
-  std::shared_ptr<Expr> factor() {
-    std::shared_ptr<Expr> expr = unary();
-
-    while (match(SLASH, STAR, MODULO)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+  // Resolves a call against the native registry, so that arity is checked
+  // here and the interpreter dispatches straight to the function.
+  std::shared_ptr<Expr> call(Token callee, const Token& paren,
+                             std::vector<std::shared_ptr<Expr>> arguments) {
+    const Native* native = NativeRegistry::instance().find(callee.lexeme);
+    if (!native) {
+      throw error(callee, "Unknown function [" + callee.lexeme + "]!");
     }
 
-    return expr;
-  }
-
-  std::shared_ptr<Expr> unary() {
-    if (match(MINUS)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      return std::make_shared<Unary>(std::move(op), right);
+    if (arguments.size() != static_cast<std::size_t>(native->arity)) {
+      throw error(paren, "[" + callee.lexeme + "] expects " +
+          std::to_string(native->arity) + " arguments but got " +
+          std::to_string(arguments.size()) + "!");
     }
 
-    return primary();
+    return std::make_shared<Call>(std::move(callee), paren,
+                                  std::move(arguments), native);
   }
 
   std::shared_ptr<Expr> primary() {
@@ -167,12 +309,6 @@ private:
       return std::make_shared<Variable>(previous());
     }
 
-    if (match(LEFT_PAREN)) {
-      std::shared_ptr<Expr> expr = expression();
-      consume(RIGHT_PAREN, "Expect ')' after expression.");
-      return std::make_shared<Grouping>(expr);
-    }
-
     throw error(peek(), "Unknown command! Does not match any valid command of the language.");
   }
 
@@ -204,6 +340,11 @@ private:
     return previous();
   }
 
+  bool checkNext(TokenType type) {
+    if (isAtEnd()) return false;
+    return tokens.at(current + 1).type == type;
+  }
+
   bool isAtEnd() {
     return peek().type == END_OF_FILE;
   }
@@ -218,17 +359,22 @@ private:
 
   ParseError error(const Token& token, std::string_view message) {
     ::error(token, message, hadError);
+    messages.emplace_back(message);
     return ParseError{""};
   }
 
   void synchronize() {
-    advance();
+    // An END closes the block the error was in, so it is not skipped.
+    if (!check(END)) advance();
 
     while (!isAtEnd()) {
 
       switch (peek().type) {
         case BEG:
         case PRINT:
+        case REPEAT:
+        case END:
+        case NEWLINE:
           return;
       }
 
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstring>      // std::memcpy
+#include <filesystem>
+#include <fstream>
+#include <iterator>     // std::make_move_iterator
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>      // std::move
+#include <vector>
+#include "Expr.h"
+#include "Natives.h"
+#include "Stmt.h"
+#include "Token.h"
+#include "TokenType.h"
+
+// A parsed script: the statements of each command, in order.
+using Program = std::vector<std::vector<std::shared_ptr<Stmt>>>;
+
+// A .snolc file is a header followed by the program in postfix order, so
+// it is decoded with a single pass and an explicit stack:
+//   "SNOLC" version:u8 sourceSize:u64 sourceTime:i64 sourceHash:u64
+//   ops...
+// Every multi-byte integer is little-endian; strings are a varint length
+// followed by the bytes.
+enum CacheOp: std::uint8_t {
+  OP_INT,         // value:i64                  pushes a Literal
+  OP_FLOAT,       // value:f64                  pushes a Literal
+  OP_VARIABLE,    // name                       pushes a Variable
+  OP_ASSIGN,      // name                       value -> Assign
+  OP_FORMULA,     // name                       value -> formula Assign
+  OP_BINARY,      // op                         left right -> Binary
+  OP_CALL,        // callee paren count:varint  arguments... -> Call
+  OP_GROUPING,    //                            expression -> Grouping
+  OP_UNARY,       // op                         right -> Unary
+  OP_EXPRESSION,  //                            expression -> statement
+  OP_PRINT,       //                            expression -> statement
+  OP_BEG,         // name                       -> statement
+  OP_BLOCK,       //                            opens a REPEAT body
+  OP_REPEAT,      // keyword                    count -> statement, closing
+                  //                            the body
+  OP_LINE,        //                            ends the current command
+};
+
+constexpr char CACHE_MAGIC[] = "SNOLC";
+constexpr std::uint8_t CACHE_VERSION = 4;
+constexpr std::size_t CACHE_TIME_OFFSET = sizeof(CACHE_MAGIC) - 1 + 1 + 8;
+constexpr std::size_t CACHE_HEADER_SIZE = CACHE_TIME_OFFSET + 8 + 8;
+
+// FNV-1a.
+inline std::uint64_t hashSource(std::string_view source) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : source) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline std::string cachePath(const std::string& scriptPath) {
+  return std::filesystem::path{scriptPath}.replace_extension(".snolc")
+      .string();
+}
+
+class ProgramWriter: public ExprVisitor,
+                     public StmtVisitor {
+  std::string out;
+  std::vector<WalkFrame> frames;
+
+public:
+  std::string write(const Program& program, std::uint64_t sourceSize,
+                    std::int64_t sourceTime, std::uint64_t sourceHash) {
+    out.assign(CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1);
+    out.push_back(static_cast<char>(CACHE_VERSION));
+    writeFixed(sourceSize);
+    writeFixed(sourceTime);
+    writeFixed(sourceHash);
+
+    for (const std::vector<std::shared_ptr<Stmt>>& line : program) {
+      for (const std::shared_ptr<Stmt>& statement : line) {
+        statement->accept(*this);
+      }
+      out.push_back(OP_LINE);
+    }
+
+    return std::move(out);
+  }
+
+private:
+  // Expressions are written in postfix order, which is the order the
+  // reader rebuilds them in, so each node writes only itself.
+  void writeExpr(const std::shared_ptr<Expr>& expr) {
+    walkPostfix(*expr, frames, [this](Expr& node) { node.accept(*this); });
+  }
+
+public:
+  std::any visitExpressionStmt(
+      std::shared_ptr<Expression> stmt) override {
+    writeExpr(stmt->expression);
+    out.push_back(OP_EXPRESSION);
+    return {};
+  }
+
+  std::any visitPrintStmt(std::shared_ptr<Print> stmt) override {
+    writeExpr(stmt->expression);
+    out.push_back(OP_PRINT);
+    return {};
+  }
+
+  std::any visitBegStmt(std::shared_ptr<Beg> stmt) override {
+    out.push_back(OP_BEG);
+    writeToken(stmt->name);
+    return {};
+  }
+
+  std::any visitRepeatStmt(std::shared_ptr<Repeat> stmt) override {
+    writeExpr(stmt->count);
+    out.push_back(OP_BLOCK);
+    for (const std::shared_ptr<Stmt>& statement : stmt->body) {
+      statement->accept(*this);
+    }
+    out.push_back(OP_REPEAT);
+    writeToken(stmt->keyword);
+    return {};
+  }
+
+  std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
+    out.push_back(expr->formula ? OP_FORMULA : OP_ASSIGN);
+    writeToken(expr->name);
+    return {};
+  }
+
+  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
+    out.push_back(OP_BINARY);
+    writeToken(expr->op);
+    return {};
+  }
+
+  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
+    out.push_back(OP_CALL);
+    writeToken(expr->callee);
+    writeToken(expr->paren);
+    writeVarint(expr->arguments.size());
+    return {};
+  }
+
+  std::any visitGroupingExpr(
+      std::shared_ptr<Grouping> expr) override {
+    out.push_back(OP_GROUPING);
+    return {};
+  }
+
+  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+    if (expr->value.type() == typeid(std::int64_t)) {
+      out.push_back(OP_INT);
+      writeFixed(std::any_cast<std::int64_t>(expr->value));
+    } else {
+      out.push_back(OP_FLOAT);
+      writeFixed(std::any_cast<double>(expr->value));
+    }
+    return {};
+  }
+
+  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
+    out.push_back(OP_UNARY);
+    writeToken(expr->op);
+    return {};
+  }
+
+  std::any visitVariableExpr(
+      std::shared_ptr<Variable> expr) override {
+    out.push_back(OP_VARIABLE);
+    writeToken(expr->name);
+    return {};
+  }
+
+private:
+  template <class T>
+  void writeFixed(T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+  }
+
+  void writeVarint(std::size_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  void writeToken(const Token& token) {
+    out.push_back(static_cast<char>(token.type));
+    writeVarint(token.lexeme.size());
+    out.append(token.lexeme);
+  }
+};
+
+class ProgramReader {
+  struct CorruptCache {};
+
+  std::string_view in;
+  std::size_t current = 0;
+
+public:
+  ProgramReader(std::string_view in)
+    : in{in}
+  {}
+
+  // Returns nothing if the cache is malformed.
+  std::optional<Program> read() {
+    try {
+      return readProgram();
+    } catch (CorruptCache) {
+      return std::nullopt;
+    }
+  }
+
+private:
+  Program readProgram() {
+    Program program;
+    std::vector<std::shared_ptr<Stmt>> line;
+    // The bodies of the REPEAT blocks being read, innermost last.
+    std::vector<std::vector<std::shared_ptr<Stmt>>> blocks;
+    std::vector<std::shared_ptr<Expr>> stack;
+    current = CACHE_HEADER_SIZE;
+
+    while (current < in.size()) {
+      std::vector<std::shared_ptr<Stmt>>& statements =
+          blocks.empty() ? line : blocks.back();
+      switch (static_cast<CacheOp>(in[current++])) {
+        case OP_INT:
+          stack.push_back(
+              std::make_shared<Literal>(readFixed<std::int64_t>()));
+          break;
+        case OP_FLOAT:
+          stack.push_back(std::make_shared<Literal>(readFixed<double>()));
+          break;
+        case OP_VARIABLE:
+          stack.push_back(std::make_shared<Variable>(readToken()));
+          break;
+        case OP_ASSIGN:
+        case OP_FORMULA: {
+          bool formula = in[current - 1] == OP_FORMULA;
+          std::shared_ptr<Expr> value = pop(stack);
+          stack.push_back(
+              std::make_shared<Assign>(readToken(), value, formula));
+          break;
+        }
+        case OP_BINARY: {
+          std::shared_ptr<Expr> right = pop(stack);
+          std::shared_ptr<Expr> left = pop(stack);
+          stack.push_back(
+              std::make_shared<Binary>(left, readToken(), right));
+          break;
+        }
+        case OP_CALL: {
+          Token callee = readToken();
+          Token paren = readToken();
+          std::size_t count = readVarint();
+          const Native* native =
+              NativeRegistry::instance().find(callee.lexeme);
+          if (!native || count != static_cast<std::size_t>(native->arity) ||
+              count > stack.size()) {
+            throw CorruptCache{};
+          }
+
+          std::vector<std::shared_ptr<Expr>> arguments(
+              std::make_move_iterator(stack.end() - count),
+              std::make_move_iterator(stack.end()));
+          stack.resize(stack.size() - count);
+          stack.push_back(std::make_shared<Call>(std::move(callee),
+              std::move(paren), std::move(arguments), native));
+          break;
+        }
+        case OP_GROUPING:
+          stack.push_back(std::make_shared<Grouping>(pop(stack)));
+          break;
+        case OP_UNARY: {
+          std::shared_ptr<Expr> right = pop(stack);
+          stack.push_back(std::make_shared<Unary>(readToken(), right));
+          break;
+        }
+        case OP_EXPRESSION:
+          statements.push_back(std::make_shared<Expression>(pop(stack)));
+          break;
+        case OP_PRINT:
+          statements.push_back(std::make_shared<Print>(pop(stack)));
+          break;
+        case OP_BEG:
+          statements.push_back(std::make_shared<Beg>(readToken(), nullptr));
+          break;
+        case OP_BLOCK:
+          if (blocks.size() == MAX_REPEAT_DEPTH) throw CorruptCache{};
+          blocks.emplace_back();
+          break;
+        case OP_REPEAT: {
+          if (blocks.empty()) throw CorruptCache{};
+          std::vector<std::shared_ptr<Stmt>> body = std::move(blocks.back());
+          blocks.pop_back();
+          std::shared_ptr<Expr> count = pop(stack);
+          (blocks.empty() ? line : blocks.back()).push_back(
+              std::make_shared<Repeat>(readToken(), std::move(count),
+                                       std::move(body)));
+          break;
+        }
+        case OP_LINE:
+          if (!stack.empty() || !blocks.empty()) throw CorruptCache{};
+          program.push_back(std::move(line));
+          line.clear();
+          break;
+        default:
+          throw CorruptCache{};
+      }
+    }
+
+    if (!stack.empty() || !line.empty() || !blocks.empty()) {
+      throw CorruptCache{};
+    }
+    return program;
+  }
+
+  static std::shared_ptr<Expr> pop(std::vector<std::shared_ptr<Expr>>& stack) {
+    if (stack.empty()) throw CorruptCache{};
+    std::shared_ptr<Expr> expr = std::move(stack.back());
+    stack.pop_back();
+    return expr;
+  }
+
+  template <class T>
+  T readFixed() {
+    if (in.size() - current < sizeof(T)) throw CorruptCache{};
+    T value;
+    std::memcpy(&value, in.data() + current, sizeof(T));
+    current += sizeof(T);
+    return value;
+  }
+
+  std::size_t readVarint() {
+    std::size_t value = 0;
+    for (int shift = 0;; shift += 7) {
+      if (current >= in.size() || shift >= 64) throw CorruptCache{};
+      auto byte = static_cast<unsigned char>(in[current++]);
+      value |= static_cast<std::size_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+  }
+
+  Token readToken() {
+    if (current >= in.size()) throw CorruptCache{};
+    auto type = static_cast<TokenType>(in[current++]);
+    if (type < 0 || type > END_OF_FILE) throw CorruptCache{};
+
+    std::size_t length = readVarint();
+    if (in.size() - current < length) throw CorruptCache{};
+    std::string lexeme{in.substr(current, length)};
+    current += length;
+    return Token{type, std::move(lexeme), nullptr};
+  }
+};
+
+inline std::int64_t sourceTime(const std::string& scriptPath) {
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(scriptPath, ec);
+  return ec ? 0 : time.time_since_epoch().count();
+}
+
+inline std::string readSource(const std::string& scriptPath) {
+  std::ifstream file{scriptPath, std::ios::binary};
+  return std::string{std::istreambuf_iterator<char>{file}, {}};
+}
+
+// Returns the cached program for scriptPath if its cache is present and
+// up to date. The source is only read when its size matches but its
+// timestamp does not; if its hash still matches, the cache is accepted and
+// its timestamp refreshed.
+inline std::optional<Program> loadProgramCache(const std::string& scriptPath) {
+  std::ifstream file{cachePath(scriptPath), std::ios::binary};
+  if (!file) return std::nullopt;
+  std::string cache{std::istreambuf_iterator<char>{file}, {}};
+  file.close();
+
+  if (cache.size() < CACHE_HEADER_SIZE ||
+      cache.compare(0, sizeof(CACHE_MAGIC) - 1, CACHE_MAGIC) != 0 ||
+      static_cast<std::uint8_t>(cache[sizeof(CACHE_MAGIC) - 1]) !=
+          CACHE_VERSION) {
+    return std::nullopt;
+  }
+
+  std::uint64_t size, hash;
+  std::int64_t time;
+  std::memcpy(&size, cache.data() + CACHE_TIME_OFFSET - 8, 8);
+  std::memcpy(&time, cache.data() + CACHE_TIME_OFFSET, 8);
+  std::memcpy(&hash, cache.data() + CACHE_TIME_OFFSET + 8, 8);
+  std::error_code ec;
+  if (size != std::filesystem::file_size(scriptPath, ec) || ec) {
+    return std::nullopt;
+  }
+
+  std::int64_t now = sourceTime(scriptPath);
+  if (time != now) {
+    if (hash != hashSource(readSource(scriptPath))) return std::nullopt;
+    std::fstream update{cachePath(scriptPath),
+                        std::ios::binary | std::ios::in | std::ios::out};
+    update.seekp(CACHE_TIME_OFFSET);
+    update.write(reinterpret_cast<const char*>(&now), sizeof(now));
+  }
+
+  return ProgramReader{cache}.read();
+}
+
+// Writes the cache for scriptPath, whose source was read at time, which
+// must come from sourceTime() before the read: a script edited since then
+// keeps an older time than its file, so the next run hashes it again.
+// Failures are ignored; the script will simply be parsed again next time.
+inline void saveProgramCache(const std::string& scriptPath, std::string_view source,
+                      std::int64_t time, const Program& program) {
+  std::string cache = ProgramWriter{}.write(program, source.size(), time,
+      hashSource(source));
+
+  std::string path = cachePath(scriptPath);
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+    if (!file.write(cache.data(), cache.size())) return;
+  }
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+}
@@ -0,0 +1,89 @@
+// Times a loop body run by REPEAT against the same body unrolled, in
+// nanoseconds per iteration, for bodies with and without loop-invariant
+// work (100,000 iterations by default):
+//   ./RepeatBench [iterations]
+// The unrolled script pays to scan and parse every copy; REPEAT parses the
+// body once and hoists its invariant subexpressions before the first
+// iteration.
+#include <chrono>
+#include <cstdlib>      // std::strtoull
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "Frontend.h"
+#include "Interpreter.h"
+
+namespace {
+
+const char* const SETUP = "x = 0\na = 3\nb = 4\nc = 2\n";
+
+double nanosecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Scans, parses and runs source, returning the time each phase took.
+struct Timing {
+  double parse;
+  double run;
+  std::string result;
+};
+
+Timing time(const std::string& source) {
+  Timing timing;
+  auto start = std::chrono::steady_clock::now();
+  ParsedCommand command = parseCommand(source);
+  timing.parse = nanosecondsSince(start);
+
+  std::ostringstream output;
+  start = std::chrono::steady_clock::now();
+  {
+    Interpreter interpreter{};
+    interpreter.output = &output;
+    interpreter.interpret(command.statements);
+    interpreter.interpret(parseCommand("PRINT x").statements);
+  }
+  timing.run = nanosecondsSince(start);
+
+  std::string result = command.errors + output.str();
+  timing.result = result.substr(result.rfind('\n', result.size() - 2) + 1);
+  timing.result.pop_back();
+  return timing;
+}
+
+void bench(const std::string& name, const std::string& body,
+           std::size_t iterations) {
+  std::string unrolled = SETUP;
+  for (std::size_t i = 0; i < iterations; ++i) unrolled += body + "\n";
+  std::string loop = SETUP + ("REPEAT " + std::to_string(iterations) + "\n")
+      + body + "\nEND\n";
+
+  Timing flat = time(unrolled);
+  Timing repeat = time(loop);
+  double n = static_cast<double>(iterations);
+  std::cout << std::left << std::setw(12) << name << std::right
+      << std::fixed << std::setprecision(1)
+      << std::setw(10) << flat.parse / n << std::setw(10) << flat.run / n
+      << std::setw(10) << repeat.parse / n << std::setw(10) << repeat.run / n
+      << "  " << flat.result << " / " << repeat.result << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t iterations =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+  std::cout << iterations << " iterations, ns per iteration\n"
+      << std::left << std::setw(12) << "case" << std::right
+      << std::setw(20) << "unrolled" << std::setw(20) << "REPEAT" << "\n"
+      << std::left << std::setw(12) << "" << std::right
+      << std::setw(10) << "parse" << std::setw(10) << "run"
+      << std::setw(10) << "parse" << std::setw(10) << "run"
+      << "  result\n";
+  bench("increment", "x = x + 1", iterations);
+  bench("invariant", "x = x + a * b - c", iterations);
+  bench("call", "x = x + abs(a * a - b * b) % c", iterations);
+  bench("grouped", "x = (x + 1) % (a + b) - min(a, b)", iterations);
+}
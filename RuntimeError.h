@@ -3,6 +3,12 @@
 #include <stdexcept>
 #include "Token.h"
 
+// The token of errors that are not the fault of any one token.
+inline const Token& noToken() {
+  static const Token token{END_OF_FILE, "", nullptr};
+  return token;
+}
+
 class RuntimeError: public std::runtime_error {
 public:
   const Token& token;
@@ -1,32 +1,242 @@
+#include <algorithm>    // std::max, std::sort
+#include <chrono>
+#include <cstdlib>      // std::atoi, std::strtoull
 #include <cstring>      // std::strerror
 #include <fstream>      // readFile
 #include <iostream>     // std::getline
+#include <iterator>     // std::istreambuf_iterator
 #include <conio.h>      // getch()
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include "Error.h"
+#include "FlightRecorder.h"
+#include "Frontend.h"
 #include "Interpreter.h"
+#include "Limits.h"
+#include "Metrics.h"
 #include "Parser.h"
+#include "ProgramCache.h"
 #include "Scanner.h"
+#include "SpscQueue.h"
+#include "Trace.h"
 
-void run(Interpreter interpreter, std::string_view source, bool& hadError) {
-  Scanner scanner {source};
-  std::vector<Token> tokens = scanner.scanTokens(hadError);
+// Where interpreters dump their flight recorders on a runtime error or
+// SIGUSR1; empty if they should not.
+std::string flightPath;
+
+// The limits of each script run, or of each command at the prompt.
+Limits limits;
+
+// Scans, parses and executes one command and returns its statements.
+// hadError is set if scanning or parsing reported an error; scanning
+// errors alone do not stop the command from running.
+std::vector<std::shared_ptr<Stmt>> run(Interpreter& interpreter,
+    std::string_view source, bool& hadError) {
+  bool hadScanError = false;
+  std::vector<Token> tokens;
+  {
+    PhaseTimer timer{SCAN};
+    Scanner scanner {source};
+    tokens = scanner.scanTokens(hadScanError);
+  }
 
     // for (const Token& token : tokens) {
     // std::cout << token.toString() << "\n";
     // }
-  Parser parser{tokens};
-  std::vector<std::shared_ptr<Stmt>> statements = parser.parse(hadError);
+  std::vector<std::shared_ptr<Stmt>> statements;
+  {
+    PhaseTimer timer{PARSE};
+    Parser parser{tokens};
+    statements = parser.parse(hadError);
+    recordParseErrors(parser.errorMessages(), interpreter.flightRecorder());
+  }
 
   // Stop if there was a syntax error.
-  if (hadError) return;
-  
-  interpreter.interpret(statements);
+  if (hadError) return statements;
+
+  {
+    PhaseTimer timer{EXECUTE};
+    interpreter.interpret(statements);
+  }
+  hadError = hadScanError;
+  return statements;
 }
 
-void runPrompt() {
+// Runs a script one command at a time, as if each were typed at the
+// prompt, optionally scanning and parsing it on several threads first. A
+// script that scans and parses without errors is cached next to it as a
+// .snolc file, and later runs execute the cached program instead.
+void runFile(const std::string& path, unsigned threads) {
   Interpreter interpreter{};
+  interpreter.flightRecorder().dumpPath = flightPath;
+  interpreter.limit(limits);
+  if (std::optional<Program> program = loadProgramCache(path)) {
+    for (const std::vector<std::shared_ptr<Stmt>>& line : *program) {
+      if (interpreter.limitExceeded()) break;
+      PhaseTimer timer{EXECUTE};
+      interpreter.interpret(line);
+    }
+    return;
+  }
+
+  // Taken before reading, so that edits made while the script runs are
+  // noticed by the next run.
+  std::int64_t time = sourceTime(path);
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error{
+        "Could not open " + path + ": " + std::strerror(errno)};
+  }
+  std::string source{std::istreambuf_iterator<char>{file}, {}};
+
+  Program program;
+  bool cacheable = true;
+  if (threads > 1) {
+    // Parse every command up front on several threads, then report each
+    // command's errors as it is reached, just as a sequential run would.
+    for (ParsedCommand& command :
+         parseParallel(untilExit(source), threads)) {
+      if (interpreter.limitExceeded()) break;
+      *errorStream << command.errors;
+      recordParseErrors(command.parseErrors, interpreter.flightRecorder());
+      if (!command.hadParseError) {
+        PhaseTimer timer{EXECUTE};
+        interpreter.interpret(command.statements);
+      }
+
+      if (command.hadScanError || command.hadParseError) cacheable = false;
+      if (cacheable) program.push_back(std::move(command.statements));
+    }
+  } else {
+    forEachCommand(untilExit(source), [&](std::string_view command) {
+      if (interpreter.limitExceeded()) return;
+      bool hadError = false;
+      std::vector<std::shared_ptr<Stmt>> statements =
+          run(interpreter, command, hadError);
+
+      if (hadError) cacheable = false;
+      if (cacheable) program.push_back(std::move(statements));
+    });
+  }
+
+  // A program cut short by a limit may be incomplete.
+  if (cacheable && !interpreter.limitExceeded()) {
+    saveProgramCache(path, source, time, program);
+  }
+}
+
+// Runs a script like runFile, but with scanning, parsing and execution
+// overlapped: a scanner thread and a parser thread work a few chunks of
+// commands ahead of the interpreter, which runs on the calling thread. Their
+// errors are written when the interpreter reaches the command that caused
+// them, so the output is the same as runFile's. The script is streamed
+// instead of read whole, and the .snolc cache is neither used nor written.
+void runPipelined(const std::string& path) {
+  constexpr std::size_t CHUNK_COMMANDS = 64;
+
+  std::ifstream file{path};
+  if (!file) {
+    throw std::runtime_error{
+        "Could not open " + path + ": " + std::strerror(errno)};
+  }
+
+  Interpreter interpreter{};
+  interpreter.flightRecorder().dumpPath = flightPath;
+  interpreter.limit(limits);
+  SpscQueue<std::vector<ScannedCommand>, 16> scanned;
+  SpscQueue<std::vector<ParsedCommand>, 16> parsed;
+
+  std::thread scanner{[&file, &scanned] {
+    std::vector<ScannedCommand> chunk;
+    std::string line;
+    std::string command;
+    int depth = 0;
+    while (std::getline(file, line) && line != "EXIT!") {
+      // Lines inside a REPEAT block are gathered into one command.
+      depth += blockDepthChange(line);
+      command += line;
+      if (depth > 0) {
+        command += '\n';
+        continue;
+      }
+      depth = 0;
+
+      chunk.push_back(scanCommand(command));
+      command.clear();
+      if (chunk.size() == CHUNK_COMMANDS) {
+        scanned.push(std::move(chunk));
+        chunk.clear();
+      }
+    }
+    if (!command.empty()) {
+      command.pop_back();
+      chunk.push_back(scanCommand(command));
+    }
+    if (!chunk.empty()) scanned.push(std::move(chunk));
+    scanned.close();
+  }};
+
+  std::thread parser{[&scanned, &parsed] {
+    std::vector<ScannedCommand> in;
+    while (scanned.pop(in)) {
+      std::vector<ParsedCommand> out;
+      out.reserve(in.size());
+      for (ScannedCommand& command : in) {
+        out.push_back(parseCommand(std::move(command)));
+      }
+      parsed.push(std::move(out));
+    }
+    parsed.close();
+  }};
+
+  std::vector<ParsedCommand> chunk;
+  while (parsed.pop(chunk)) {
+    for (ParsedCommand& command : chunk) {
+      // Once a limit is hit, the rest is drained so the threads can finish.
+      if (interpreter.limitExceeded()) break;
+      *errorStream << command.errors;
+      recordParseErrors(command.parseErrors, interpreter.flightRecorder());
+      if (command.hadParseError) continue;
+
+      PhaseTimer timer{EXECUTE};
+      interpreter.interpret(command.statements);
+    }
+  }
+
+  scanner.join();
+  parser.join();
+}
+
+// Reads the remaining lines of a command at the prompt until every REPEAT
+// block its first line opened is closed, or input ends.
+void readBlock(std::string& command) {
+  int depth = blockDepthChange(command);
+  std::string line;
+  while (depth > 0) {
+    std::cout << "...      ";
+    if (!std::getline(std::cin, line)) break;
+    depth += blockDepthChange(line);
+    command += '\n';
+    command += line;
+  }
+}
+
+// Runs the interactive prompt. With a trace, every command, every BEG
+// answer and the output of each command are recorded for replay.
+void runPrompt(TraceWriter* trace) {
+  Interpreter interpreter{};
+  interpreter.flightRecorder().dumpPath = flightPath;
+  if (trace) {
+    interpreter.readLine = [trace](std::string& line) {
+      if (!std::getline(std::cin, line)) return false;
+      trace->write(TRACE_INPUT, line);
+      return true;
+    };
+  }
   bool hadError = false;
   bool hadRuntimeError = false;
   std::cout << "The SNOL environment is now active, you may proceed with" << std::endl
@@ -40,11 +250,159 @@ void runPrompt() {
     	getch();
     	break;
 	  }
-    run(interpreter, line, hadError);
+    readBlock(line);
+    interpreter.limit(limits);
+    if (trace) {
+      trace->write(TRACE_COMMAND, line);
+      std::string output;
+      {
+        OutputCapture out{std::cout, output, true};
+        OutputCapture err{std::cerr, output, true};
+        run(interpreter, line, hadError);
+      }
+      trace->write(TRACE_OUTPUT, output);
+    } else {
+      run(interpreter, line, hadError);
+    }
     hadError = false;
   }
 }
 
+struct RecordedCommand {
+  std::string line;
+  std::vector<std::string> inputs;
+  std::string output;
+};
+
+// Feeds a recorded session back through the interpreter without prompts
+// or pauses, checks that every command reproduces its recorded output and
+// reports per-command latency percentiles. Returns the number of commands
+// whose output differed.
+int runReplay(const std::string& path) {
+  std::vector<RecordedCommand> commands;
+  TraceReader reader{path};
+  TraceRecord record;
+  while (reader.next(record)) {
+    if (record.type == TRACE_COMMAND) {
+      commands.push_back({std::move(record.text), {}, {}});
+    } else if (commands.empty()) {
+      throw std::runtime_error{"Trace record precedes the first command."};
+    } else if (record.type == TRACE_INPUT) {
+      commands.back().inputs.push_back(std::move(record.text));
+    } else if (record.type == TRACE_OUTPUT) {
+      commands.back().output = std::move(record.text);
+    }
+  }
+
+  Interpreter interpreter{};
+  interpreter.flightRecorder().dumpPath = flightPath;
+  const std::vector<std::string>* inputs = nullptr;
+  std::size_t nextInput = 0;
+  interpreter.readLine = [&inputs, &nextInput](std::string& line) {
+    if (nextInput == inputs->size()) return false;
+    line = (*inputs)[nextInput++];
+    return true;
+  };
+
+  std::vector<double> latencies;
+  int mismatches = 0;
+  for (std::size_t i = 0; i < commands.size(); ++i) {
+    inputs = &commands[i].inputs;
+    nextInput = 0;
+    interpreter.limit(limits);
+    bool hadError = false;
+    std::string output;
+    auto start = std::chrono::steady_clock::now();
+    {
+      OutputCapture out{std::cout, output, false};
+      OutputCapture err{std::cerr, output, false};
+      run(interpreter, commands[i].line, hadError);
+    }
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count());
+
+    if (output != commands[i].output) {
+      ++mismatches;
+      std::cerr << "Command " << i + 1 << " [" << commands[i].line
+          << "] does not match its recorded output.\n";
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    if (latencies.empty()) return 0.0;
+    std::size_t rank = static_cast<std::size_t>(p * (latencies.size() - 1));
+    return latencies[rank];
+  };
+  std::cout << "Replayed " << commands.size() << " commands, "
+      << mismatches << " mismatched.\n"
+      << "Latency (us): p50 " << percentile(0.50)
+      << ", p90 " << percentile(0.90)
+      << ", p99 " << percentile(0.99)
+      << ", max " << percentile(1.0) << "\n";
+  return mismatches;
+}
+
 int main(int argc, char* argv[]) {
-  runPrompt();
-}
\ No newline at end of file
+  std::string script;
+  std::string record;
+  std::string replay;
+  std::string metrics;
+  bool pipeline = false;
+  unsigned threads = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--record" && i + 1 < argc) {
+      record = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay = argv[++i];
+    } else if (arg == "--metrics" && i + 1 < argc) {
+      metrics = argv[++i];
+    } else if (arg == "--flight" && i + 1 < argc) {
+      flightPath = argv[++i];
+    } else if (arg == "--pipeline") {
+      pipeline = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--max-steps" && i + 1 < argc) {
+      limits.maxSteps = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--max-variables" && i + 1 < argc) {
+      limits.maxVariables = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--timeout" && i + 1 < argc) {
+      limits.timeout = std::chrono::milliseconds{
+          std::strtoll(argv[++i], nullptr, 10)};
+    } else if (arg[0] != '-' && script.empty()) {
+      script = argv[i];
+    } else {
+      std::cout << "Usage: SNOL [--metrics file] [--flight file] "
+          "[--max-steps n] [--max-variables n] [--timeout ms] "
+          "[[--pipeline | --threads n] script | --record trace | --replay trace]\n";
+      return 64;
+    }
+  }
+
+  if (!flightPath.empty()) FlightRecorder::installSignalHandler();
+
+  try {
+    std::optional<MetricsExporter> exporter;
+    if (!metrics.empty()) {
+      exporter.emplace(metrics, std::chrono::seconds{5});
+    }
+
+    if (!replay.empty()) {
+      return runReplay(replay) == 0 ? 0 : 1;
+    } else if (!script.empty() && pipeline) {
+      runPipelined(script);
+    } else if (!script.empty()) {
+      runFile(script, threads);
+    } else if (!record.empty()) {
+      TraceWriter trace{record};
+      runPrompt(&trace);
+    } else {
+      runPrompt(nullptr);
+    }
+  } catch (const std::runtime_error& error) {
+    std::cerr << error.what() << "\n";
+    return 74;
+  }
+}
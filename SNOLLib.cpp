@@ -0,0 +1,134 @@
+#include <sstream>
+#include <string>
+#include <utility>      // std::move
+#include <vector>
+#include "BatchEvaluator.h"
+#include "Frontend.h"
+#include "Interpreter.h"
+#include "SNOLLib.h"
+
+namespace snol {
+
+class Program {
+public:
+  std::vector<std::vector<std::shared_ptr<Stmt>>> lines;
+};
+
+std::shared_ptr<const Program> compile(std::string_view source) {
+  auto program = std::make_shared<Program>();
+  std::string errors;
+  forEachCommand(untilExit(source), [&](std::string_view text) {
+    ParsedCommand command = parseCommand(text);
+    errors += command.errors;
+    program->lines.push_back(std::move(command.statements));
+  });
+
+  if (!errors.empty()) throw CompileError{errors};
+  return program;
+}
+
+class Expression {
+public:
+  std::shared_ptr<Expr> expr;
+};
+
+std::shared_ptr<const Expression> compileExpression(std::string_view source) {
+  ParsedCommand command = parseCommand("PRINT " + std::string{source});
+  if (!command.errors.empty()) throw CompileError{command.errors};
+
+  auto print = command.statements.size() == 1
+      ? std::dynamic_pointer_cast<Print>(command.statements[0]) : nullptr;
+  if (!print) throw CompileError{"Error! Expected a single expression!\n"};
+
+  auto expression = std::make_shared<Expression>();
+  expression->expr = print->expression;
+  return expression;
+}
+
+BatchResult evaluate(const Expression& expression,
+                     const std::map<std::string, Column>& columns,
+                     std::size_t rows) {
+  return BatchEvaluator{columns}.evaluate(expression.expr, rows);
+}
+
+// Contexts keep a short flight recorder, since they are meant to be cheap.
+constexpr std::size_t CONTEXT_FLIGHT_EVENTS = 64;
+
+Context::Context(std::shared_ptr<SharedEnvironment> shared)
+  : interpreter{std::make_unique<Interpreter>(std::move(shared),
+                                              CONTEXT_FLIGHT_EVENTS)}
+{
+  interpreter->readLine = [](std::string&) { return false; };
+}
+
+Context::~Context() = default;
+Context::Context(Context&&) noexcept = default;
+Context& Context::operator=(Context&&) noexcept = default;
+
+void Context::set(const std::string& name, Value value) {
+  Token token{IDENTIFIER, name, nullptr};
+  std::visit([&](auto number) { interpreter->assign(token, number); }, value);
+}
+
+std::optional<Value> Context::get(const std::string& name) {
+  if (!interpreter->defined(name)) return std::nullopt;
+
+  Token token{IDENTIFIER, name, nullptr};
+  std::any value = interpreter->lookup(token);
+  if (value.type() == typeid(std::int64_t)) {
+    return std::any_cast<std::int64_t>(value);
+  }
+  return std::any_cast<double>(value);
+}
+
+void Context::limit(const Limits& limits) {
+  this->limits = limits;
+  interpreter->limit(limits);
+}
+
+namespace {
+
+// Points an interpreter's output at a buffer while it exists, so the
+// interpreter never keeps a pointer to a buffer that is gone, even when
+// execution throws.
+class OutputRedirect {
+  Interpreter& interpreter;
+  std::ostringstream output;
+
+public:
+  OutputRedirect(Interpreter& interpreter)
+    : interpreter{interpreter}
+  {
+    interpreter.output = &output;
+  }
+
+  ~OutputRedirect() {
+    interpreter.output = &std::cout;
+  }
+
+  std::string text() const {
+    return output.str();
+  }
+};
+
+}  // namespace
+
+Result Context::execute(const Program& program) {
+  OutputRedirect output{*interpreter};
+  interpreter->limit(limits);
+
+  Result result;
+  {
+    ErrorCapture errors;
+    for (const std::vector<std::shared_ptr<Stmt>>& line : program.lines) {
+      if (interpreter->limitExceeded()) break;
+      interpreter->interpret(line);
+    }
+    result.errors = errors.text();
+  }
+  result.limitExceeded = interpreter->limitExceeded();
+  result.output = output.text();
+  return result;
+}
+
+}  // namespace snol
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include "Column.h"
+#include "Limits.h"
+#include "SharedEnvironment.h"
+
+class Interpreter;
+
+// The embeddable SNOL API, built as libsnol. Source is compiled once into
+// an immutable Program that any number of Contexts, on any threads, can
+// execute; each Context holds one session's variables.
+namespace snol {
+
+using Value = std::variant<std::int64_t, double>;
+
+// Thrown by compile() with every scan and parse error, one per line.
+class CompileError: public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+class Program;
+
+// Scans and parses source, where each line, or each REPEAT block, is one
+// command as at the prompt. Lines after one reading "EXIT!" are ignored.
+std::shared_ptr<const Program> compile(std::string_view source);
+
+class Expression;
+
+// Scans and parses a single expression, such as "a * b + 1", for
+// evaluate(). Throws CompileError as compile() does.
+std::shared_ptr<const Expression> compileExpression(std::string_view source);
+
+// Evaluates expression for each of rows rows at once, where row i reads
+// element i of each variable's column. Errors that depend on the values,
+// like division by zero, fail their row only and are returned in
+// BatchResult::errors. Errors that would fail every row, like mixing ints
+// and floats or a variable without a column, throw a RuntimeError.
+BatchResult evaluate(const Expression& expression,
+                     const std::map<std::string, Column>& columns,
+                     std::size_t rows);
+
+struct Result {
+  std::string output;  // everything PRINT wrote
+  std::string errors;  // runtime errors, one per line
+  bool limitExceeded = false;  // whether execution was cut short
+};
+
+class Context {
+  std::unique_ptr<Interpreter> interpreter;
+  Limits limits;
+
+public:
+  // Variables not set in this context are looked up in shared, if given.
+  Context(std::shared_ptr<SharedEnvironment> shared = nullptr);
+  ~Context();
+
+  Context(Context&&) noexcept;
+  Context& operator=(Context&&) noexcept;
+
+  // Assigns a variable, as "name = value" would; formulas reading it are
+  // recomputed when next read. BEG statements have no input in a context,
+  // so programs should receive their inputs this way. Throws LimitError
+  // if name is new and the context already has Limits::maxVariables
+  // variables.
+  void set(const std::string& name, Value value);
+
+  // Returns the value of a variable, or nothing if it is not defined. A
+  // formula whose inputs changed is recomputed first, and a RuntimeError
+  // is thrown if that fails, for example on a division by zero.
+  std::optional<Value> get(const std::string& name);
+
+  // Bounds every later execute() call, and set() right away. No limits
+  // apply by default.
+  void limit(const Limits& limits);
+
+  // Runs program against this context's variables. As at the prompt, a
+  // runtime error stops the rest of its line only, but exceeding a limit
+  // stops the whole program.
+  Result execute(const Program& program);
+};
+
+}  // namespace snol
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <utility>      // std::move
@@ -41,12 +43,22 @@ private:
     switch (c) {
       case '(': addToken(LEFT_PAREN); break;
       case ')': addToken(RIGHT_PAREN); break;
+      case ',': addToken(COMMA); break;
       case '-': addToken(MINUS); break;
       case '+': addToken(PLUS); break;
       case '*': addToken(STAR); break;
       case '/': addToken(SLASH); break;
       case '%': addToken(MODULO); break;
+      // Commands are single lines, except for REPEAT blocks.
+      case '\n': addToken(NEWLINE); break;
       case '=': addToken(EQUAL); break;
+      case ':':
+        if (match('=')) {
+          addToken(COLON_EQUAL);
+        } else {
+          error("Unexpected character.", hadError);
+        }
+        break;
 
       case ' ':
       case '\r':
@@ -108,12 +120,24 @@ private:
       temp.push_back('0');
     }
 
-    if (isInt)
-      addToken(INT,
-          std::stoi(temp));
-    else
-      addToken(FLOAT,
-          std::stod(temp));
+    try {
+      if (isInt)
+        addToken(INT,
+            static_cast<std::int64_t>(std::stoll(temp)));
+      else
+        addToken(FLOAT,
+            std::stod(temp));
+    } catch (const std::out_of_range&) {
+      error("Number is too large.", hadError);
+    }
+  }
+
+  bool match(char expected) {
+    if (isAtEnd()) return false;
+    if (source[current] != expected) return false;
+
+    ++current;
+    return true;
   }
 
   char peek() {
@@ -157,8 +181,10 @@ private:
   }
 };
 
-const std::map<std::string, TokenType> Scanner::keywords =
+inline const std::map<std::string, TokenType> Scanner::keywords =
 {
   {"BEG",    TokenType::BEG},
   {"PRINT",  TokenType::PRINT},
+  {"REPEAT", TokenType::REPEAT},
+  {"END",    TokenType::END},
 };
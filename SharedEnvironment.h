@@ -0,0 +1,66 @@
+#pragma once
+
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>      // std::move
+
+// Constants and reference variables shared by many sessions, each of which
+// layers its own Environment on top. The variables are published as
+// immutable snapshots: a writer copies the current snapshot, changes the
+// copy and swaps it in, while readers keep using whichever snapshot they
+// already hold. A snapshot is freed once its last reader lets go of it.
+class SharedEnvironment {
+public:
+  using Snapshot = std::map<std::string, std::any>;
+
+private:
+  // Only accessed through std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Snapshot> current = std::make_shared<Snapshot>();
+  // Bumped after every publish, so readers can check for a new snapshot
+  // with a single atomic load.
+  std::atomic<std::uint64_t> version{1};
+  std::mutex writer;
+
+public:
+  std::uint64_t currentVersion() const {
+    return version.load(std::memory_order_acquire);
+  }
+
+  std::shared_ptr<const Snapshot> snapshot() const {
+    return std::atomic_load(&current);
+  }
+
+  // Defines a shared variable. Values are stored as the interpreter keeps
+  // them, so any integer becomes a SNOL int (std::int64_t) and any
+  // floating-point number a SNOL float (double); other types do not
+  // compile.
+  template <class Number,
+            std::enable_if_t<std::is_arithmetic_v<Number> &&
+                             !std::is_same_v<Number, bool>, int> = 0>
+  void define(const std::string& name, Number value) {
+    std::any stored;
+    if constexpr (std::is_floating_point_v<Number>) {
+      stored = static_cast<double>(value);
+    } else {
+      stored = static_cast<std::int64_t>(value);
+    }
+    update([&](Snapshot& values) { values[name] = std::move(stored); });
+  }
+
+  // Applies change to a copy of the current snapshot and publishes it.
+  template <class Change>
+  void update(Change change) {
+    std::lock_guard<std::mutex> lock{writer};
+    auto next = std::make_shared<Snapshot>(*std::atomic_load(&current));
+    change(*next);
+    std::atomic_store(&current,
+                      std::shared_ptr<const Snapshot>{std::move(next)});
+    version.fetch_add(1, std::memory_order_release);
+  }
+};
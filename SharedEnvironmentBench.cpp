@@ -0,0 +1,85 @@
+// Times reads of shared variables from 1, 2, 4 and 8 threads, each with its
+// own session Environment, against reads that take a new snapshot every
+// time. std::atomic_load of a shared_ptr goes through a small pool of
+// global locks in libstdc++, so the second column stops scaling once
+// threads contend for them; the version check only loads an integer.
+//   ./SharedEnvironmentBench [reads per thread]
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>      // std::strtoull
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Environment.h"
+#include "SharedEnvironment.h"
+#include "Token.h"
+
+namespace {
+
+// Runs read(session, name) reads times on each of threads threads and
+// returns the total reads per microsecond.
+template <class Read>
+double bench(const std::shared_ptr<SharedEnvironment>& shared,
+             int threads, std::uint64_t reads, Read read) {
+  std::atomic<bool> go{false};
+  std::atomic<std::int64_t> sink{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      Environment session{shared};
+      session.assign(Token{IDENTIFIER, "local", nullptr}, std::int64_t{1});
+      Token name{IDENTIFIER, "rate", nullptr};
+      while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+      std::int64_t sum = 0;
+      for (std::uint64_t i = 0; i < reads; ++i) {
+        sum += std::any_cast<std::int64_t>(read(session, name));
+      }
+      sink.fetch_add(sum, std::memory_order_relaxed);
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread& worker : workers) worker.join();
+  double microseconds = std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count();
+  return threads * reads / microseconds;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::uint64_t reads = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                 : 2000000;
+
+  auto shared = std::make_shared<SharedEnvironment>();
+  for (int i = 0; i < 64; ++i) {
+    shared->define("constant" + std::to_string(i), std::int64_t{i});
+  }
+  shared->define("rate", std::int64_t{3});
+
+  std::cout << reads << " reads per thread on "
+      << std::thread::hardware_concurrency()
+      << " hardware threads, millions of reads per second\n"
+      << std::setw(8) << "threads" << std::setw(12) << "version"
+      << std::setw(12) << "snapshot" << "\n";
+  for (int threads : {1, 2, 4, 8}) {
+    double versioned = bench(shared, threads, reads,
+        [](Environment& session, const Token& name) {
+          return session.get(name);
+        });
+    double snapshots = bench(shared, threads, reads,
+        [&](Environment&, const Token& name) {
+          return shared->snapshot()->at(name.lexeme);
+        });
+    std::cout << std::fixed << std::setprecision(1)
+        << std::setw(8) << threads << std::setw(12) << versioned
+        << std::setw(12) << snapshots << "\n";
+  }
+}
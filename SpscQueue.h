@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>      // std::move
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread. Each side owns one index, so pushing and popping only need a
+// load of the other side's index and a store of their own. A side that
+// finds the queue full or empty sleeps until the other side moves its
+// index, so a stalled consumer (an interpreter waiting on BEG, say) leaves
+// the producer blocked rather than spinning.
+template <class T, std::size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two.");
+
+  T slots[Capacity];
+  alignas(64) std::atomic<std::size_t> head{0};  // next slot to pop
+  alignas(64) std::atomic<std::size_t> tail{0};  // next slot to push
+  std::atomic<bool> closed{false};
+
+  // A sleeping side raises its flag under the mutex before checking the
+  // queue one last time; the other side only takes the mutex to wake it
+  // when the flag is up. Indices and flags are sequentially consistent,
+  // so either the sleeper sees the new index or the waker sees the flag.
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::atomic<bool> producerWaiting{false};
+  std::atomic<bool> consumerWaiting{false};
+
+public:
+  void push(T value) {
+    std::size_t back = tail.load(std::memory_order_relaxed);
+    if (back - head.load(std::memory_order_acquire) == Capacity) {
+      wait(producerWaiting, [&] { return back - head.load() != Capacity; });
+    }
+    slots[back % Capacity] = std::move(value);
+    tail.store(back + 1);
+    wake(consumerWaiting);
+  }
+
+  // Called by the producer after its last push.
+  void close() {
+    closed.store(true);
+    wake(consumerWaiting);
+  }
+
+  // Returns false once the queue is closed and drained.
+  bool pop(T& value) {
+    std::size_t front = head.load(std::memory_order_relaxed);
+    if (front == tail.load(std::memory_order_acquire)) {
+      wait(consumerWaiting,
+           [&] { return front != tail.load() || closed.load(); });
+      if (front == tail.load()) return false;
+    }
+    value = std::move(slots[front % Capacity]);
+    head.store(front + 1);
+    wake(producerWaiting);
+    return true;
+  }
+
+private:
+  template <class Ready>
+  void wait(std::atomic<bool>& waiting, Ready ready) {
+    std::unique_lock<std::mutex> lock{mutex};
+    waiting.store(true);
+    changed.wait(lock, ready);
+    waiting.store(false);
+  }
+
+  void wake(std::atomic<bool>& waiting) {
+    if (!waiting.load()) return;
+    // Taking the mutex orders this after the sleeper's last check, so the
+    // notification cannot slip in before it starts waiting.
+    { std::lock_guard<std::mutex> lock{mutex}; }
+    changed.notify_one();
+  }
+};
@@ -11,11 +11,13 @@
 struct Expression;
 struct Print;
 struct Beg;
+struct Repeat;
 
 struct StmtVisitor {
   virtual std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) = 0;
   virtual std::any visitPrintStmt(std::shared_ptr<Print> stmt) = 0;
   virtual std::any visitBegStmt(std::shared_ptr<Beg> stmt) = 0;
+  virtual std::any visitRepeatStmt(std::shared_ptr<Repeat> stmt) = 0;
   virtual ~StmtVisitor() = default;
 };
 
@@ -60,3 +62,22 @@ struct Beg: Stmt, public std::enable_shared_from_this<Beg> {
   const std::shared_ptr<Expr> initializer;
 };
 
+// How deeply REPEAT blocks may nest. Parsing, running, caching and freeing
+// a block all recurse into its body, so deeper blocks are a parse error.
+constexpr int MAX_REPEAT_DEPTH = 256;
+
+struct Repeat: Stmt, public std::enable_shared_from_this<Repeat> {
+  Repeat(Token keyword, std::shared_ptr<Expr> count,
+         std::vector<std::shared_ptr<Stmt>> body)
+    : keyword{std::move(keyword)}, count{std::move(count)},
+      body{std::move(body)}
+  {}
+
+  std::any accept(StmtVisitor& visitor)override {
+    return visitor.visitRepeatStmt(shared_from_this());
+  }
+
+  const Token keyword;
+  const std::shared_ptr<Expr> count;
+  const std::vector<std::shared_ptr<Stmt>> body;
+};
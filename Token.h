@@ -1,6 +1,7 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <string>
 #include <utility>      // std::move
 #include "TokenType.h"
@@ -24,7 +25,7 @@ public:
         literal_text = lexeme;
         break;
       case (INT):
-        literal_text = std::to_string(std::any_cast<int>(literal));
+        literal_text = std::to_string(std::any_cast<std::int64_t>(literal));
         break;
       case (FLOAT):
         literal_text = std::to_string(std::any_cast<double>(literal));
@@ -5,26 +5,26 @@
 enum TokenType {
   // Single-character tokens.
   LEFT_PAREN, RIGHT_PAREN,
-  DOT, MINUS, PLUS, SLASH, STAR, MODULO,
+  COMMA, DOT, MINUS, PLUS, SLASH, STAR, MODULO, NEWLINE,
 
-  EQUAL,
+  EQUAL, COLON_EQUAL,
 
   // Literals.
   IDENTIFIER, INT, FLOAT,
 
   // Keywords.
-  BEG, PRINT,
+  BEG, PRINT, REPEAT, END,
 
   END_OF_FILE,
 };
 
-std::string toString(TokenType type) {
+inline std::string toString(TokenType type) {
   static const std::string strings[] = {
     "LEFT_PAREN", "RIGHT_PAREN",
-    "DOT", "MINUS", "PLUS", "SLASH", "STAR", "MODULO",
-    "EQUAL",
+    "COMMA", "DOT", "MINUS", "PLUS", "SLASH", "STAR", "MODULO", "NEWLINE",
+    "EQUAL", "COLON_EQUAL",
     "IDENTIFIER", "INT", "FLOAT",
-    "BEG", "PRINT",
+    "BEG", "PRINT", "REPEAT", "END",
     "END_OF_FILE"
   };
 
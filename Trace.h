@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>      // std::move
+#include <vector>
+
+// A session trace is the header "SNOLTRC" plus a version byte, followed by
+// records of: type byte, varint time delta in microseconds since the
+// previous record, varint text length, text bytes.
+enum TraceRecordType: char {
+  TRACE_COMMAND = 'C',  // a line typed at the "Command:" prompt
+  TRACE_INPUT = 'I',    // a line answering a BEG prompt
+  TRACE_OUTPUT = 'O',   // everything the command wrote to stdout and stderr
+};
+
+struct TraceRecord {
+  TraceRecordType type;
+  std::uint64_t time;   // microseconds since the session started
+  std::string text;
+};
+
+constexpr char TRACE_MAGIC[] = "SNOLTRC";
+constexpr char TRACE_VERSION = 1;
+
+class TraceWriter {
+  std::ofstream out;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::uint64_t last = 0;
+
+public:
+  TraceWriter(const std::string& path)
+    : out{path, std::ios::binary}
+  {
+    if (!out) throw std::runtime_error{"Could not open trace " + path};
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1);
+    out.put(TRACE_VERSION);
+  }
+
+  void write(TraceRecordType type, std::string_view text) {
+    std::uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    out.put(type);
+    writeVarint(now - last);
+    writeVarint(text.size());
+    out.write(text.data(), text.size());
+    out.flush();
+    last = now;
+  }
+
+private:
+  void writeVarint(std::uint64_t value) {
+    while (value >= 0x80) {
+      out.put(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+  }
+};
+
+class TraceReader {
+  std::ifstream in;
+  std::uint64_t time = 0;
+
+public:
+  TraceReader(const std::string& path)
+    : in{path, std::ios::binary}
+  {
+    if (!in) throw std::runtime_error{"Could not open trace " + path};
+    char header[sizeof(TRACE_MAGIC)];
+    in.read(header, sizeof(header));
+    if (!in || std::string_view{header, sizeof(header) - 1} != TRACE_MAGIC ||
+        header[sizeof(header) - 1] != TRACE_VERSION) {
+      throw std::runtime_error{path + " is not a SNOL trace."};
+    }
+  }
+
+  bool next(TraceRecord& record) {
+    char type;
+    if (!in.get(type)) return false;
+    time += readVarint();
+    std::string text(readVarint(), '\0');
+    in.read(text.data(), text.size());
+    if (!in) throw std::runtime_error{"Truncated trace record."};
+    record = {static_cast<TraceRecordType>(type), time, std::move(text)};
+    return true;
+  }
+
+private:
+  std::uint64_t readVarint() {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int byte = in.get();
+      if (byte == EOF) throw std::runtime_error{"Truncated trace record."};
+      value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    return value;
+  }
+};
+
+// Appends what is written to a stream to text, optionally passing it
+// through to the stream's original buffer. Several captures may share one
+// text so that stdout and stderr keep their relative order.
+class OutputCapture: public std::streambuf {
+  std::ostream& stream;
+  std::string& text;
+  bool passThrough;
+  std::streambuf* original;
+
+public:
+  OutputCapture(std::ostream& stream, std::string& text, bool passThrough)
+    : stream{stream}, text{text}, passThrough{passThrough},
+      original{stream.rdbuf(this)}
+  {}
+
+  ~OutputCapture() {
+    stream.rdbuf(original);
+  }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (c == traits_type::eof()) return traits_type::not_eof(c);
+    text.push_back(traits_type::to_char_type(c));
+    if (passThrough) return original->sputc(traits_type::to_char_type(c));
+    return c;
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    text.append(s, n);
+    if (passThrough) return original->sputn(s, n);
+    return n;
+  }
+
+  int sync() override {
+    return passThrough ? original->pubsync() : 0;
+  }
+};